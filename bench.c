@@ -0,0 +1,284 @@
+#include "bench.h"
+#include "mylib/genlib.h"
+#include "mylib/mathlib.h"
+#include "mylib/taskpool.h"
+#include "mylib/timing.h"
+
+#define BENCH_ITERATIONS 1000000
+#define BENCH_STRINGS 1024
+#define BENCH_NOISE_SIZE 1024 // pixels square
+#define BENCH_NOISE_TILE 64
+
+// Keeps results alive so the compiler can't throw the work away.
+static volatile u64 sink;
+
+static u64 start_ns;
+
+static void Start(void)
+{
+    start_ns = Now();
+}
+
+static void Stop(const char * name, int ops)
+{
+    u64 ns = Now() - start_ns;
+
+    printf("  %-34s %8.2f ns/op\n", name, (double)ns / ops);
+}
+
+#pragma mark - VECTOR
+
+static void BenchVector(void)
+{
+    puts("vector:");
+
+    Start();
+    for ( int n = 0; n < 100; n++ ) {
+        VECTOR(int) v = { 0 };
+        for ( int i = 0; i < BENCH_ITERATIONS / 100; i++ ) {
+            VectorPush(v, i);
+        }
+        sink += VectorLast(v);
+        VectorFree(v);
+    }
+    Stop("push (heap)", BENCH_ITERATIONS);
+
+    arena_t arena = NewArena(0, false);
+    Start();
+    for ( int n = 0; n < 100; n++ ) {
+        VECTOR(int) v = { .arena = &arena };
+        for ( int i = 0; i < BENCH_ITERATIONS / 100; i++ ) {
+            VectorPush(v, i);
+        }
+        sink += VectorLast(v);
+        ResetArena(&arena);
+    }
+    Stop("push (arena)", BENCH_ITERATIONS);
+    FreeArena(&arena);
+
+    // what it replaces: a fixed STORAGE array
+    static STORAGE(int, storage, BENCH_ITERATIONS / 100) storage;
+    Start();
+    for ( int n = 0; n < 100; n++ ) {
+        CLEAR(storage);
+        for ( int i = 0; i < BENCH_ITERATIONS / 100; i++ ) {
+            APPEND(storage, i);
+        }
+        sink += LAST(storage);
+    }
+    Stop("append (fixed STORAGE)", BENCH_ITERATIONS);
+}
+
+#pragma mark - HASH MAP
+
+static void BenchIntegerMap(int size)
+{
+    u64 * keys = malloc(size * sizeof(*keys));
+    hashmap_t map = NewHashMap(false, NULL);
+
+    for ( int i = 0; i < size; i++ ) {
+        keys[i] = HashBytes(&i, sizeof(i), FNV_OFFSET);
+        MapPut(&map, keys[i], &keys[i]);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "get, %d integer keys", size);
+    Start();
+    for ( int i = 0; i < BENCH_ITERATIONS; i++ ) {
+        sink += *(u64 *)MapGet(&map, keys[i % size]);
+    }
+    Stop(name, BENCH_ITERATIONS);
+
+    // what it replaces: a linear search, as the label cache did
+    int iterations = BENCH_ITERATIONS / 10;
+    snprintf(name, sizeof(name), "linear search, %d integer keys", size);
+    Start();
+    for ( int i = 0; i < iterations; i++ ) {
+        u64 key = keys[i % size];
+        for ( int j = 0; j < size; j++ ) {
+            if ( keys[j] == key ) {
+                sink += j;
+                break;
+            }
+        }
+    }
+    Stop(name, iterations);
+
+    Start();
+    for ( int n = 0; n < 10; n++ ) {
+        hashmap_t m = NewHashMap(false, NULL);
+        for ( int i = 0; i < size; i++ ) {
+            MapPut(&m, keys[i], &keys[i]);
+        }
+        for ( int i = 0; i < size; i++ ) {
+            MapRemove(&m, keys[i]);
+        }
+        FreeHashMap(&m);
+    }
+    snprintf(name, sizeof(name), "put + remove, %d integer keys", size);
+    Stop(name, size * 10);
+
+    FreeHashMap(&map);
+    free(keys);
+}
+
+static void BenchStringMap(void)
+{
+    arena_t arena = NewArena(0, false);
+    char ** strings = ArenaAlloc(&arena, BENCH_STRINGS * sizeof(*strings));
+    hashmap_t map = NewHashMap(true, &arena);
+
+    for ( int i = 0; i < BENCH_STRINGS; i++ ) {
+        strings[i] = ArenaPrintf(&arena, "texture_%04d.bmp", i);
+        MapPutString(&map, strings[i], strings[i]);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "get, %d string keys", BENCH_STRINGS);
+    Start();
+    for ( int i = 0; i < BENCH_ITERATIONS; i++ ) {
+        sink += (uintptr_t)MapGetString(&map, strings[i % BENCH_STRINGS]);
+    }
+    Stop(name, BENCH_ITERATIONS);
+
+    // what it replaces: the strcmp loop texture.c used
+    int iterations = BENCH_ITERATIONS / 100;
+    snprintf(name, sizeof(name), "strcmp search, %d string keys", BENCH_STRINGS);
+    Start();
+    for ( int i = 0; i < iterations; i++ ) {
+        const char * key = strings[i % BENCH_STRINGS];
+        for ( int j = 0; j < BENCH_STRINGS; j++ ) {
+            if ( strcmp(strings[j], key) == 0 ) {
+                sink += j;
+                break;
+            }
+        }
+    }
+    Stop(name, iterations);
+
+    FreeArena(&arena);
+}
+
+#pragma mark - ARENA
+
+static void BenchArena(void)
+{
+    puts("allocation:");
+
+    arena_t arena = NewArena(0, false);
+    Start();
+    for ( int i = 0; i < BENCH_ITERATIONS; i++ ) {
+        arena_mark_t mark = ArenaMark(&arena);
+        char * buffer = ArenaAlloc(&arena, 64 + i % 256);
+        buffer[0] = i;
+        sink += buffer[0];
+        ArenaRelease(&arena, mark);
+    }
+    Stop("arena alloc + release", BENCH_ITERATIONS);
+    FreeArena(&arena);
+
+    Start();
+    for ( int i = 0; i < BENCH_ITERATIONS; i++ ) {
+        char * buffer = malloc(64 + i % 256);
+        buffer[0] = i;
+        sink += buffer[0];
+        free(buffer);
+    }
+    Stop("malloc + free", BENCH_ITERATIONS);
+}
+
+#pragma mark - TIMING
+
+static void BenchTiming(void)
+{
+    printf("timing (%s):\n", TimingUsesTSC() ? "tsc" : "clock_gettime");
+
+    Start();
+    for ( int i = 0; i < BENCH_ITERATIONS; i++ ) {
+        sink += Now();
+    }
+    Stop("Now()", BENCH_ITERATIONS);
+
+    Start();
+    for ( int i = 0; i < BENCH_ITERATIONS; i++ ) {
+        sink += SDL_GetPerformanceCounter();
+    }
+    Stop("SDL_GetPerformanceCounter()", BENCH_ITERATIONS);
+}
+
+#pragma mark - TASK POOL
+
+static void NoiseTile(SDL_Rect tile, void * data)
+{
+    float * out = data;
+
+    for ( int y = tile.y; y < tile.y + tile.h; y++ ) {
+        for ( int x = tile.x; x < tile.x + tile.w; x++ ) {
+            out[y * BENCH_NOISE_SIZE + x]
+                = Noise2(x, y, 0.0f, 0.01f, 6, 1.0f, 0.5f, 2.0f);
+        }
+    }
+}
+
+// Generate the same noise with 1 to N workers.
+static void BenchTaskPool(void)
+{
+    int max_workers = DefaultWorkerCount();
+    float * out = malloc(BENCH_NOISE_SIZE * BENCH_NOISE_SIZE * sizeof(*out));
+    SDL_Rect area = { 0, 0, BENCH_NOISE_SIZE, BENCH_NOISE_SIZE };
+    double base_ms = 0.0;
+
+    printf("task pool: %dx%d noise in %dx%d tiles, %d CPUs available\n",
+           BENCH_NOISE_SIZE, BENCH_NOISE_SIZE,
+           BENCH_NOISE_TILE, BENCH_NOISE_TILE,
+           max_workers);
+
+    // The calling thread runs tasks while it waits, so N threads is N - 1
+    // workers. With no pool at all, tasks run as they're added.
+    for ( int threads = 1; threads <= max_workers; threads++ ) {
+        if ( threads > 1 ) {
+            InitTaskPool(threads - 1);
+        }
+
+        u64 start = Now();
+        task_group_t group = { 0 };
+        ParallelForTiles
+        (   &group,
+            area,
+            BENCH_NOISE_TILE,
+            BENCH_NOISE_TILE,
+            NoiseTile,
+            out );
+        WaitTaskGroup(&group);
+
+        double ms = MsSince(start);
+        if ( threads == 1 ) {
+            base_ms = ms;
+        }
+
+        task_pool_stats_t stats = TaskPoolStats();
+        printf("  %2d threads %10.2f ms %6.2fx speedup %6d steals\n",
+               threads, ms, base_ms / ms, stats.steals);
+
+        ShutdownTaskPool();
+    }
+
+    sink += out[BENCH_NOISE_SIZE / 2];
+    free(out);
+}
+
+#pragma mark -
+
+void RunBenchmarks(void)
+{
+    BenchVector();
+
+    puts("hash map:");
+    BenchIntegerMap(64);
+    BenchIntegerMap(4096);
+    BenchStringMap();
+
+    BenchArena();
+    BenchTiming();
+    BenchTaskPool();
+}
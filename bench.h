@@ -0,0 +1,14 @@
+// -----------------------------------------------------------------------------
+//  Benchmarks
+//
+//  Micro-benchmarks for the genlib containers and allocators, and the task
+//  pool's scaling, run with `worldtweak --bench`. Each one is compared
+//  against what it replaced.
+// -----------------------------------------------------------------------------
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+/// Run all benchmarks and print the results.
+void RunBenchmarks(void);
+
+#endif /* __BENCH_H__ */
@@ -0,0 +1,135 @@
+#include "cache.h"
+
+typedef struct cached_world {
+    u64 key;
+    int width;
+    int height;
+    u8 * classes; // layer index per pixel
+    struct cached_world * prev; // more recently used
+    struct cached_world * next; // less recently used
+} cached_world_t;
+
+static cached_world_t * head; // most recently used
+static cached_world_t * tail; // least recently used
+static size_t budget = DEFAULT_CACHE_BUDGET;
+static cache_stats_t stats;
+
+static size_t WorldBytes(int width, int height)
+{
+    return (size_t)width * height * sizeof(u8);
+}
+
+static void Unlink(cached_world_t * world)
+{
+    if ( world->prev ) {
+        world->prev->next = world->next;
+    } else {
+        head = world->next;
+    }
+
+    if ( world->next ) {
+        world->next->prev = world->prev;
+    } else {
+        tail = world->prev;
+    }
+
+    world->prev = world->next = NULL;
+}
+
+static void PushFront(cached_world_t * world)
+{
+    world->next = head;
+    world->prev = NULL;
+
+    if ( head ) {
+        head->prev = world;
+    } else {
+        tail = world;
+    }
+
+    head = world;
+}
+
+static void Remove(cached_world_t * world)
+{
+    Unlink(world);
+    stats.bytes -= WorldBytes(world->width, world->height);
+    stats.count--;
+    MemFree(world->classes);
+    MemFree(world);
+}
+
+static void Evict(void)
+{
+    while ( tail && stats.bytes > budget ) {
+        Remove(tail);
+    }
+}
+
+void SetCacheBudget(size_t bytes)
+{
+    budget = bytes;
+    Evict();
+}
+
+const u8 * FindCachedWorld(u64 key, int width, int height)
+{
+    for ( cached_world_t * w = head; w; w = w->next ) {
+        if ( w->key == key && w->width == width && w->height == height ) {
+            Unlink(w);
+            PushFront(w);
+            stats.hits++;
+            return w->classes;
+        }
+    }
+
+    stats.misses++;
+    return NULL;
+}
+
+void CacheWorld(u64 key, const u8 * classes, int width, int height)
+{
+    size_t size = WorldBytes(width, height);
+
+    if ( size > budget ) {
+        return;
+    }
+
+    // replace any stale copy
+    for ( cached_world_t * w = head; w; w = w->next ) {
+        if ( w->key == key && w->width == width && w->height == height ) {
+            Remove(w);
+            break;
+        }
+    }
+
+    cached_world_t * world = MemCalloc(MEM_CACHE, 1, sizeof(*world));
+    if ( world == NULL || (world->classes = MemAlloc(MEM_CACHE, size)) == NULL ) {
+        Error("out of memory");
+    }
+
+    memcpy(world->classes, classes, size);
+    world->key = key;
+    world->width = width;
+    world->height = height;
+
+    PushFront(world);
+    stats.bytes += size;
+    stats.count++;
+    Evict();
+}
+
+void ClearCache(void)
+{
+    while ( head ) {
+        Remove(head);
+    }
+}
+
+cache_stats_t CacheStats(void)
+{
+    cache_stats_t result = stats;
+    result.budget = budget;
+
+    return result;
+}
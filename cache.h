@@ -0,0 +1,43 @@
+// -----------------------------------------------------------------------------
+//  World Cache
+//
+//  In-memory LRU cache of generated worlds, keyed by a hash of everything
+//  that affects the result. Least recently used worlds are dropped once
+//  the cache grows past its byte budget.
+// -----------------------------------------------------------------------------
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "mylib/genlib.h"
+
+#define DEFAULT_CACHE_BUDGET (256 * 1024 * 1024) // bytes
+
+typedef struct {
+    int hits;
+    int misses;
+    int count;      // number of worlds currently cached
+    size_t bytes;   // total size of cached buffers
+    size_t budget;
+} cache_stats_t;
+
+/// Set the maximum number of bytes of world data the cache may hold. Worlds
+/// are evicted immediately if the cache is now over budget.
+void SetCacheBudget(size_t bytes);
+
+/// Look up a previously generated world.
+/// - Returns: The cached class map, or `NULL` if there is no world with
+///   this key and size. It remains valid until the next call to
+///   `CacheWorld()`, `SetCacheBudget()`, or `ClearCache()`, any of which
+///   may free it.
+const u8 * FindCachedWorld(u64 key, int width, int height);
+
+/// Store a copy of a generated world's class map. Worlds that are larger
+/// than the whole budget are not cached.
+void CacheWorld(u64 key, const u8 * classes, int width, int height);
+
+/// Remove all worlds from the cache.
+void ClearCache(void);
+
+cache_stats_t CacheStats(void);
+
+#endif /* __CACHE_H__ */
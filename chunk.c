@@ -0,0 +1,528 @@
+#include "chunk.h"
+#include "mylib/mathlib.h"
+#include "mylib/profiler.h"
+#include "mylib/resultqueue.h"
+#include "mylib/taskpool.h"
+#include "mylib/video.h"
+
+#define NUM_BUCKETS         1024 // must be a power of two
+#define MAX_WORKERS         16
+#define UPLOADS_PER_FRAME   8
+#define MAX_RESULTS         64 // finished chunks waiting for the main thread
+#define RESULTS_PER_FRAME   32 // taken from the queue each frame
+#define CHUNK_TEXELS        (CHUNK_SIZE * CHUNK_SIZE)
+#define CHUNK_BYTES         (CHUNK_TEXELS * (sizeof(u32) + sizeof(u8)))
+
+typedef enum {
+    CHUNK_QUEUED,       // waiting for a worker
+    CHUNK_GENERATING,   // a worker is filling in its pixels, or it's done
+                        // and the result is in the queue
+    CHUNK_READY,        // classes are done, waiting for upload
+    CHUNK_UPLOADED,     // has an up to date texture
+} chunk_state_t;
+
+typedef struct chunk {
+    int cx; // chunk coordinate, i.e. world x / ChunkSpan(lod)
+    int cy;
+    int lod;
+
+    // Only the main thread creates, destroys, and looks up chunks. Workers
+    // only touch chunks they took off the queue. `state` and `last_used`
+    // are protected by `lock` until the chunk is uploaded.
+    chunk_state_t state;
+    u32 last_used; // frame number
+    u8 * classes; // kept after upload so the chunk can be recolored
+    SDL_Texture * texture;
+
+    struct chunk * bucket_next;
+    struct chunk * queue_prev;
+    struct chunk * queue_next;
+} chunk_t;
+
+static chunk_generator_t generator;
+static u32 palette[16];
+static size_t budget;
+static chunk_t * buckets[NUM_BUCKETS];
+static u32 frame;
+static int uploads; // this frame
+static int deferred; // ready chunks drawn this frame that weren't uploaded
+static chunk_stats_t stats;
+
+static SDL_mutex * lock;
+static SDL_cond * work_available;
+static SDL_cond * work_finished;
+static SDL_Thread * workers[MAX_WORKERS];
+static int num_workers;
+static result_queue_t results; // finished chunks: handle, classes
+
+// protected by lock:
+static chunk_t * queue_head;
+static int num_generating;
+static bool quit;
+static bool wake_pending; // a chunk_ready_event is in the event queue
+
+u32 chunk_ready_event;
+
+// world pixels covered by the width of a chunk
+static float ChunkSpan(int lod)
+{
+    return (float)CHUNK_SIZE / (1 << lod);
+}
+
+#pragma mark - QUEUE
+
+static void Enqueue(chunk_t * chunk)
+{
+    chunk->queue_prev = NULL;
+    chunk->queue_next = queue_head;
+
+    if ( queue_head ) {
+        queue_head->queue_prev = chunk;
+    }
+
+    queue_head = chunk;
+    stats.queued++;
+}
+
+static void Dequeue(chunk_t * chunk)
+{
+    if ( chunk->queue_prev ) {
+        chunk->queue_prev->queue_next = chunk->queue_next;
+    } else {
+        queue_head = chunk->queue_next;
+    }
+
+    if ( chunk->queue_next ) {
+        chunk->queue_next->queue_prev = chunk->queue_prev;
+    }
+
+    chunk->queue_prev = chunk->queue_next = NULL;
+    stats.queued--;
+}
+
+// The most recently wanted chunk, since after a bit of scrolling, the
+// oldest requests may well be off screen.
+static chunk_t * NextQueued(void)
+{
+    chunk_t * next = queue_head;
+
+    for ( chunk_t * c = queue_head; c; c = c->queue_next ) {
+        if ( c->last_used > next->last_used ) {
+            next = c;
+        }
+    }
+
+    return next;
+}
+
+static int Worker(void * data)
+{
+    (void)data;
+    SetProfilerThreadName("chunk worker");
+
+    SDL_LockMutex(lock);
+
+    while ( !quit ) {
+        chunk_t * chunk = NextQueued();
+
+        if ( chunk == NULL ) {
+            SDL_CondWait(work_available, lock);
+            continue;
+        }
+
+        Dequeue(chunk);
+        chunk->state = CHUNK_GENERATING;
+        num_generating++;
+        u32 generation = ResultGeneration(&results);
+        SDL_UnlockMutex(lock);
+
+        u8 * classes = MemAlloc(MEM_GENERATION, CHUNK_TEXELS * sizeof(*classes));
+        if ( classes == NULL ) {
+            Error("out of memory");
+        }
+
+        float span = ChunkSpan(chunk->lod);
+        generator
+        (   chunk->cx * span,
+            chunk->cy * span,
+            span / CHUNK_SIZE,
+            CHUNK_SIZE,
+            CHUNK_SIZE,
+            classes );
+
+        // Hand it to the main thread. If ResetChunks() happened meanwhile,
+        // the chunk is about to be freed, so just throw the pixels away.
+        result_t result = { generation, chunk, classes };
+        if ( !PushResultWait(&results, result) ) {
+            MemFree(classes);
+        }
+
+        SDL_LockMutex(lock);
+        num_generating--;
+        SDL_CondBroadcast(work_finished);
+
+        if ( !wake_pending ) {
+            SDL_Event event = { .type = chunk_ready_event };
+            SDL_PushEvent(&event);
+            wake_pending = true;
+        }
+    }
+
+    SDL_UnlockMutex(lock);
+
+    return 0;
+}
+
+#pragma mark - CACHE
+
+static unsigned Bucket(int cx, int cy, int lod)
+{
+    unsigned hash = (unsigned)cx * 73856093u
+        ^ (unsigned)cy * 19349663u
+        ^ (unsigned)lod * 83492791u;
+
+    return hash & (NUM_BUCKETS - 1);
+}
+
+static chunk_t * FindChunk(int cx, int cy, int lod)
+{
+    for ( chunk_t * c = buckets[Bucket(cx, cy, lod)]; c; c = c->bucket_next ) {
+        if ( c->cx == cx && c->cy == cy && c->lod == lod ) {
+            return c;
+        }
+    }
+
+    return NULL;
+}
+
+static chunk_t * NewChunk(int cx, int cy, int lod)
+{
+    chunk_t * chunk = MemCalloc(MEM_GENERATION, 1, sizeof(*chunk));
+    if ( chunk == NULL ) {
+        Error("out of memory");
+    }
+
+    chunk->cx = cx;
+    chunk->cy = cy;
+    chunk->lod = lod;
+    chunk->last_used = frame;
+
+    unsigned b = Bucket(cx, cy, lod);
+    chunk->bucket_next = buckets[b];
+    buckets[b] = chunk;
+
+    stats.count++;
+    stats.bytes += CHUNK_BYTES;
+
+    SDL_LockMutex(lock);
+    chunk->state = CHUNK_QUEUED;
+    Enqueue(chunk);
+    SDL_CondSignal(work_available);
+    SDL_UnlockMutex(lock);
+
+    return chunk;
+}
+
+// The chunk must not be in the generating state.
+static void FreeChunk(chunk_t * chunk)
+{
+    chunk_t ** link = &buckets[Bucket(chunk->cx, chunk->cy, chunk->lod)];
+    while ( *link != chunk ) {
+        link = &(*link)->bucket_next;
+    }
+    *link = chunk->bucket_next;
+
+    if ( chunk->texture ) {
+        ReleaseTexture(chunk->texture);
+        stats.uploaded--;
+    }
+
+    MemFree(chunk->classes);
+    MemFree(chunk);
+
+    stats.count--;
+    stats.bytes -= CHUNK_BYTES;
+}
+
+// Free least recently used chunks, other than those drawn in the current
+// frame, until the cache is under budget.
+static void Evict(void)
+{
+    while ( stats.bytes > budget ) {
+        chunk_t * oldest = NULL;
+
+        SDL_LockMutex(lock);
+
+        for ( int b = 0; b < NUM_BUCKETS; b++ ) {
+            for ( chunk_t * c = buckets[b]; c; c = c->bucket_next ) {
+                if ( c->last_used != frame
+                    && c->state != CHUNK_GENERATING
+                    && (oldest == NULL || c->last_used < oldest->last_used) )
+                {
+                    oldest = c;
+                }
+            }
+        }
+
+        if ( oldest && oldest->state == CHUNK_QUEUED ) {
+            Dequeue(oldest);
+        }
+
+        SDL_UnlockMutex(lock);
+
+        if ( oldest == NULL ) {
+            return; // everything left is in use
+        }
+
+        FreeChunk(oldest);
+    }
+}
+
+static void DiscardResult(result_t * result)
+{
+    MemFree(result->buffer);
+}
+
+// Move finished chunks from the queue into the cache, ready for upload.
+static void TakeResults(void)
+{
+    result_t result;
+    int taken = 0;
+
+    while ( taken++ < RESULTS_PER_FRAME && PopResult(&results, &result) ) {
+        chunk_t * chunk = result.handle;
+
+        SDL_LockMutex(lock);
+        chunk->classes = result.buffer;
+        chunk->state = CHUNK_READY;
+        SDL_UnlockMutex(lock);
+    }
+}
+
+static void Upload(chunk_t * chunk)
+{
+    if ( chunk->texture == NULL ) {
+        chunk->texture = AcquireTexture
+        (   SDL_PIXELFORMAT_RGBA8888,
+            SDL_TEXTUREACCESS_STREAMING,
+            CHUNK_SIZE,
+            CHUNK_SIZE );
+        SDL_SetTextureBlendMode(chunk->texture, SDL_BLENDMODE_BLEND);
+        stats.uploaded++;
+    }
+
+    UpdateTextureIndexed
+    (   chunk->texture,
+        NULL,
+        chunk->classes,
+        CHUNK_SIZE,
+        palette );
+
+    chunk->state = CHUNK_UPLOADED;
+}
+
+#pragma mark - PUBLIC FUNCTIONS
+
+void InitChunks(chunk_generator_t _generator, size_t _budget)
+{
+    generator = _generator;
+    budget = _budget;
+    chunk_ready_event = SDL_RegisterEvents(1);
+
+    lock = SDL_CreateMutex();
+    work_available = SDL_CreateCond();
+    work_finished = SDL_CreateCond();
+
+    if ( lock == NULL || work_available == NULL || work_finished == NULL ) {
+        Error("could not create chunk locks (%s)", SDL_GetError());
+    }
+
+    InitResultQueue(&results, MAX_RESULTS, DiscardResult);
+
+    // leave a core for the main thread
+    num_workers = MIN(MAX(DefaultWorkerCount() - 1, 1), MAX_WORKERS);
+
+    for ( int i = 0; i < num_workers; i++ ) {
+        workers[i] = SDL_CreateThread(Worker, "chunk worker", NULL);
+
+        if ( workers[i] == NULL ) {
+            Error("could not create chunk worker (%s)", SDL_GetError());
+        }
+    }
+}
+
+void SetChunkPalette(const u32 _palette[16])
+{
+    if ( memcmp(palette, _palette, sizeof(palette)) == 0 ) {
+        return;
+    }
+
+    memcpy(palette, _palette, sizeof(palette));
+
+    // Mark uploaded chunks for re-upload. They keep their textures and are
+    // drawn with the old colors until then.
+    SDL_LockMutex(lock);
+    for ( int b = 0; b < NUM_BUCKETS; b++ ) {
+        for ( chunk_t * c = buckets[b]; c; c = c->bucket_next ) {
+            if ( c->state == CHUNK_UPLOADED ) {
+                c->state = CHUNK_READY;
+            }
+        }
+    }
+    SDL_UnlockMutex(lock);
+}
+
+void ShutdownChunks(void)
+{
+    if ( lock == NULL ) {
+        return;
+    }
+
+    ResetChunks();
+
+    SDL_LockMutex(lock);
+    quit = true;
+    SDL_CondBroadcast(work_available);
+    SDL_UnlockMutex(lock);
+
+    for ( int i = 0; i < num_workers; i++ ) {
+        SDL_WaitThread(workers[i], NULL);
+    }
+
+    FreeResultQueue(&results);
+    SDL_DestroyCond(work_finished);
+    SDL_DestroyCond(work_available);
+    SDL_DestroyMutex(lock);
+    lock = NULL;
+}
+
+void ResetChunks(void)
+{
+    SDL_LockMutex(lock);
+
+    while ( queue_head ) {
+        Dequeue(queue_head);
+    }
+
+    // Make everything in flight stale first, so workers stuck waiting for
+    // room in the queue give up.
+    NextResultGeneration(&results);
+
+    while ( num_generating > 0 ) {
+        SDL_CondWait(work_finished, lock);
+    }
+
+    SDL_UnlockMutex(lock);
+
+    result_t result;
+    while ( PopResult(&results, &result) ) // all stale, so discarded
+        ;
+
+    for ( int b = 0; b < NUM_BUCKETS; b++ ) {
+        while ( buckets[b] ) {
+            FreeChunk(buckets[b]);
+        }
+    }
+}
+
+void DrawChunks
+(   int center_x,
+    int center_y,
+    float scale,
+    int win_w,
+    int win_h,
+    int lod,
+    const SDL_Rect * bounds )
+{
+    // visible area in world pixels
+    float half_w = (win_w / 2) / scale;
+    float half_h = (win_h / 2) / scale;
+    float x0 = center_x - half_w;
+    float y0 = center_y - half_h;
+    float x1 = center_x + half_w;
+    float y1 = center_y + half_h;
+
+    if ( bounds ) {
+        x0 = MAX(x0, bounds->x);
+        y0 = MAX(y0, bounds->y);
+        x1 = MIN(x1, bounds->x + bounds->w - 1);
+        y1 = MIN(y1, bounds->y + bounds->h - 1);
+    }
+
+    float span = ChunkSpan(lod);
+    int cx0 = floorf(x0 / span);
+    int cy0 = floorf(y0 / span);
+    int cx1 = floorf(x1 / span);
+    int cy1 = floorf(y1 / span);
+    for ( int cy = cy0; cy <= cy1; cy++ ) {
+        for ( int cx = cx0; cx <= cx1; cx++ ) {
+            chunk_t * chunk = FindChunk(cx, cy, lod);
+
+            if ( chunk == NULL ) {
+                NewChunk(cx, cy, lod);
+                stats.misses++;
+                continue;
+            }
+
+            // workers change the state of queued chunks
+            SDL_LockMutex(lock);
+            chunk_state_t state = chunk->state;
+            chunk->last_used = frame;
+            SDL_UnlockMutex(lock);
+
+            if ( state != CHUNK_UPLOADED ) {
+                if ( state == CHUNK_READY && uploads < UPLOADS_PER_FRAME ) {
+                    Upload(chunk);
+                    uploads++;
+                } else if ( state == CHUNK_READY ) {
+                    deferred++;
+                }
+
+                if ( chunk->texture == NULL ) {
+                    stats.misses++;
+                    continue;
+                }
+                // else: waiting to be recolored, draw the old colors
+            }
+
+            stats.hits++;
+            stats.drawn++;
+
+            SDL_Rect dst = {
+                .x = win_w / 2 + (cx * span - center_x) * scale,
+                .y = win_h / 2 + (cy * span - center_y) * scale,
+                .w = span * scale,
+                .h = span * scale,
+            };
+            DrawTexture(chunk->texture, NULL, &dst);
+        }
+    }
+}
+
+void BeginChunkFrame(void)
+{
+    TakeResults();
+    Evict();
+
+    SDL_LockMutex(lock);
+    wake_pending = false;
+    SDL_UnlockMutex(lock);
+
+    frame++;
+    uploads = 0;
+    deferred = 0;
+    stats.drawn = 0;
+}
+
+bool ChunksPending(void)
+{
+    return deferred > 0 || ResultsQueued(&results) > 0;
+}
+
+chunk_stats_t ChunkStats(void)
+{
+    chunk_stats_t result = stats;
+    result.budget = budget;
+
+    return result;
+}
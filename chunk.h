@@ -0,0 +1,92 @@
+// -----------------------------------------------------------------------------
+//  Chunks
+//
+//  An endless world made of square chunks, generated on worker threads as
+//  they come into view. Each finished chunk gets its own texture. Chunks are
+//  kept in an LRU cache under a memory budget.
+//
+//  Chunks also come in finer levels of detail for zoomed-in views: a chunk
+//  at LOD n has the same number of texels but covers 1/2^n as much of the
+//  world, sampling the noise at fractional world coordinates.
+// -----------------------------------------------------------------------------
+#ifndef __CHUNK_H__
+#define __CHUNK_H__
+
+#include "mylib/genlib.h"
+
+#define CHUNK_SIZE 256 // in texels, and in world pixels at LOD 0
+#define MAX_CHUNK_LOD 6
+#define DEFAULT_CHUNK_BUDGET (256 * 1024 * 1024) // bytes
+
+/// Fill `classes` (w * h palette indices, see `ExpandPalette()`) with the
+/// world region at x, y, sampled every `step` world pixels. This is called
+/// from worker threads, so it must only read shared state. It must be a
+/// pure function of position so that chunks meet seamlessly.
+typedef void (* chunk_generator_t)
+(   float x,
+    float y,
+    float step,
+    int w,
+    int h,
+    u8 * classes );
+
+typedef struct {
+    int count;      // chunks in the cache, in any state
+    int queued;     // waiting for a worker
+    int uploaded;   // have a texture
+    int drawn;      // drawn since `BeginChunkFrame()`
+    size_t bytes;
+    size_t budget;
+    int hits;       // visible chunks that were ready to draw
+    int misses;     // visible chunks that weren't
+} chunk_stats_t;
+
+/// Event type pushed when chunks finish generating, so that a main loop
+/// blocked waiting for events wakes up to draw them. At most one is pushed
+/// per call to `BeginChunkFrame()`.
+extern u32 chunk_ready_event;
+
+/// Start worker threads.
+void InitChunks(chunk_generator_t generator, size_t budget);
+
+/// Set the colors chunk classes are drawn with. Chunks already uploaded
+/// are recolored over the next few frames without being regenerated.
+void SetChunkPalette(const u32 palette[16]);
+
+/// Stop worker threads and free all chunks.
+void ShutdownChunks(void);
+
+/// Throw away all chunks, e.g. because the world parameters changed. Waits
+/// for any chunks currently being generated, so when this returns no worker
+/// is reading shared state.
+void ResetChunks(void);
+
+/// Start a new frame. Chunks used since the last call are safe from
+/// eviction until the next one.
+void BeginChunkFrame(void);
+
+/// Draw all chunks of a level of detail that overlap the window, and queue
+/// any that aren't generated yet. Must be called from the main thread.
+/// - Parameter center_x, center_y: The world coordinate at the center of
+///   the window.
+/// - Parameter scale: Screen pixels per world pixel.
+/// - Parameter lod: Level of detail, `0...MAX_CHUNK_LOD`.
+/// - Parameter bounds: The region of the world, in world pixels, to draw
+///   chunks for, or `NULL` for no limit.
+void DrawChunks
+(   int center_x,
+    int center_y,
+    float scale,
+    int win_w,
+    int win_h,
+    int lod,
+    const SDL_Rect * bounds );
+
+/// Whether any chunks drawn since `BeginChunkFrame()` were generated but
+/// couldn't be uploaded yet, or finished chunks are still waiting to be
+/// taken from the workers, i.e. the next frame will draw something new.
+bool ChunksPending(void);
+
+chunk_stats_t ChunkStats(void);
+
+#endif /* __CHUNK_H__ */
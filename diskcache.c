@@ -0,0 +1,298 @@
+#include "diskcache.h"
+#include "mylib/mathlib.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAGIC       0x43575457 // "WTWC"
+#define EXTENSION   ".world"
+
+typedef struct {
+    u32 magic;
+    u32 version;    // NOISE_VERSION at the time it was written
+    u64 key;
+    s32 width;
+    s32 height;
+    u64 checksum;   // HashBytes() of everything after the header
+} header_t;
+
+static char directory[1024]; // empty if the disk cache is disabled
+static size_t budget;
+static disk_cache_stats_t stats;
+
+static size_t PayloadSize(int width, int height)
+{
+    return (size_t)width * height * (sizeof(float) + sizeof(u8));
+}
+
+static void EntryPath(char * path, size_t size, u64 key)
+{
+    snprintf
+    (   path,
+        size,
+        "%s/%016llx" EXTENSION,
+        directory,
+        (unsigned long long)key );
+}
+
+// mkdir -p
+static bool MakeDirectory(const char * path)
+{
+    char partial[sizeof(directory)];
+    snprintf(partial, sizeof(partial), "%s", path);
+
+    for ( char * c = partial + 1; *c; c++ ) {
+        if ( *c == '/' ) {
+            *c = '\0';
+            if ( mkdir(partial, 0755) != 0 && errno != EEXIST ) {
+                return false;
+            }
+            *c = '/';
+        }
+    }
+
+    return mkdir(partial, 0755) == 0 || errno == EEXIST;
+}
+
+// delete least recently used entries until the cache fits the budget
+// - Parameter keep: A file name to never delete (the entry just written,
+//   which can easily share its modification time with others), or `NULL`.
+static void Evict(const char * keep)
+{
+    typedef struct {
+        char name[64];
+        time_t time;
+        size_t size;
+    } file_t;
+
+    DIR * dir = opendir(directory);
+    if ( dir == NULL ) {
+        return;
+    }
+
+    file_t * files = NULL;
+    int count = 0;
+    int capacity = 0;
+    size_t total = 0;
+
+    struct dirent * entry;
+    while (( entry = readdir(dir) )) {
+        const char * ext = strrchr(entry->d_name, '.');
+        if ( ext == NULL
+            || strcmp(ext, EXTENSION) != 0
+            || strlen(entry->d_name) >= sizeof(files[0].name) ) {
+            continue;
+        }
+
+        char path[sizeof(directory) + 64];
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+
+        struct stat st;
+        if ( stat(path, &st) != 0 ) {
+            continue;
+        }
+
+        if ( keep && strcmp(entry->d_name, keep) == 0 ) {
+            total += st.st_size; // counts, but is never a candidate
+            continue;
+        }
+
+        if ( count == capacity ) {
+            capacity = capacity ? capacity * 2 : 64;
+            files = MemRealloc(MEM_CACHE, files, capacity * sizeof(*files));
+            if ( files == NULL ) {
+                Error("out of memory");
+            }
+        }
+
+        strcpy(files[count].name, entry->d_name);
+        files[count].time = st.st_mtime;
+        files[count].size = st.st_size;
+        total += st.st_size;
+        count++;
+    }
+    closedir(dir);
+
+    while ( total > budget && count > 0 ) {
+        int oldest = 0;
+        for ( int i = 1; i < count; i++ ) {
+            if ( files[i].time < files[oldest].time ) {
+                oldest = i;
+            }
+        }
+
+        char path[sizeof(directory) + 64];
+        snprintf(path, sizeof(path), "%s/%s", directory, files[oldest].name);
+        unlink(path);
+
+        total -= files[oldest].size;
+        files[oldest] = files[--count];
+    }
+
+    MemFree(files);
+}
+
+void InitDiskCache(size_t _budget)
+{
+    budget = _budget;
+
+    const char * xdg = getenv("XDG_CACHE_HOME");
+    const char * home = getenv("HOME");
+
+    if ( xdg && *xdg ) {
+        snprintf(directory, sizeof(directory), "%s/worldtweak", xdg);
+    } else if ( home && *home ) {
+        snprintf(directory, sizeof(directory), "%s/.cache/worldtweak", home);
+    } else {
+        directory[0] = '\0';
+        return;
+    }
+
+    if ( !MakeDirectory(directory) ) {
+        fprintf(stderr, "disk cache disabled: could not create %s\n", directory);
+        directory[0] = '\0';
+        return;
+    }
+
+    Evict(NULL);
+}
+
+// OpenDiskEntry(), minus the bookkeeping.
+static bool MapEntry(u64 key, int width, int height, disk_entry_t * entry)
+{
+    char path[sizeof(directory) + 64];
+    EntryPath(path, sizeof(path), key);
+
+    int fd = open(path, O_RDONLY);
+    if ( fd == -1 ) {
+        return false;
+    }
+
+    struct stat st;
+    size_t size = sizeof(header_t) + PayloadSize(width, height);
+    if ( fstat(fd, &st) != 0 || (size_t)st.st_size != size ) {
+        close(fd);
+        unlink(path);
+        return false;
+    }
+
+    void * mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if ( mapping == MAP_FAILED ) {
+        return false;
+    }
+
+    const header_t * header = mapping;
+    const u8 * payload = (const u8 *)(header + 1);
+
+    if ( header->magic != MAGIC
+        || header->version != NOISE_VERSION
+        || header->key != key
+        || header->width != width
+        || header->height != height
+        || header->checksum != HashBytes(payload, size - sizeof(*header), FNV_OFFSET) )
+    {
+        fprintf(stderr, "disk cache: ignoring corrupt entry %s\n", path);
+        munmap(mapping, size);
+        unlink(path);
+        return false;
+    }
+
+    utimes(path, NULL); // mark as recently used
+
+    entry->width = width;
+    entry->height = height;
+    entry->field = (const float *)payload;
+    entry->classes = payload + (size_t)width * height * sizeof(float);
+    entry->mapping = mapping;
+    entry->mapping_size = size;
+
+    return true;
+}
+
+bool OpenDiskEntry(u64 key, int width, int height, disk_entry_t * entry)
+{
+    if ( directory[0] == '\0' ) {
+        return false;
+    }
+
+    if ( MapEntry(key, width, height, entry) ) {
+        stats.hits++;
+        return true;
+    }
+
+    stats.misses++;
+    return false;
+}
+
+void CloseDiskEntry(disk_entry_t * entry)
+{
+    if ( entry->mapping ) {
+        munmap(entry->mapping, entry->mapping_size);
+    }
+
+    memset(entry, 0, sizeof(*entry));
+}
+
+void StoreDiskEntry
+(   u64 key,
+    int width,
+    int height,
+    const float * field,
+    const u8 * classes )
+{
+    if ( directory[0] == '\0' ) {
+        return;
+    }
+
+    size_t count = (size_t)width * height;
+    if ( sizeof(header_t) + PayloadSize(width, height) > budget ) {
+        return;
+    }
+
+    header_t header = {
+        .magic = MAGIC,
+        .version = NOISE_VERSION,
+        .key = key,
+        .width = width,
+        .height = height,
+    };
+    header.checksum = HashBytes(field, count * sizeof(*field), FNV_OFFSET);
+    header.checksum = HashBytes(classes, count, header.checksum);
+
+    // write to a temporary file and rename it into place, so that a crash
+    // or a second instance never sees a half-written entry (the counter is
+    // for stores running at the same time on different threads)
+    static SDL_atomic_t temp_count;
+    char path[sizeof(directory) + 64];
+    char temp[sizeof(path) + 32];
+    EntryPath(path, sizeof(path), key);
+    snprintf(temp, sizeof(temp), "%s.%d.%d",
+             path, (int)getpid(), SDL_AtomicAdd(&temp_count, 1));
+
+    FILE * file = fopen(temp, "wb");
+    if ( file == NULL ) {
+        return;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(field, sizeof(*field), count, file) == count
+        && fwrite(classes, sizeof(*classes), count, file) == count;
+
+    if ( fclose(file) != 0 || !ok || rename(temp, path) != 0 ) {
+        unlink(temp);
+        return;
+    }
+
+    Evict(strrchr(path, '/') + 1);
+}
+
+disk_cache_stats_t DiskCacheStats(void)
+{
+    return stats;
+}
@@ -0,0 +1,57 @@
+// -----------------------------------------------------------------------------
+//  Disk Cache
+//
+//  Persistent, content-addressed cache of generated noise fields and
+//  classified maps, kept under $XDG_CACHE_HOME/worldtweak (or
+//  ~/.cache/worldtweak) so that worlds survive between runs.
+// -----------------------------------------------------------------------------
+#ifndef __DISKCACHE_H__
+#define __DISKCACHE_H__
+
+#include "mylib/genlib.h"
+
+#define DEFAULT_DISK_CACHE_BUDGET (512 * 1024 * 1024) // bytes
+
+/// A cache entry mapped into memory. The buffers point into the mapping and
+/// are valid until `CloseDiskEntry()`.
+typedef struct {
+    int width;
+    int height;
+    const float * field;    // raw noise values, width * height
+    const u8 * classes;     // layer index per pixel, width * height
+
+    void * mapping;
+    size_t mapping_size;
+} disk_entry_t;
+
+typedef struct {
+    int hits;
+    int misses; // including entries that were corrupt or the wrong size
+} disk_cache_stats_t;
+
+/// Find (and create if needed) the cache directory. If this fails the disk
+/// cache is disabled and all other functions do nothing.
+/// - Parameter budget: Maximum total size in bytes of all cache files.
+void InitDiskCache(size_t budget);
+
+/// Map the cache entry for `key` into memory.
+/// - Returns: `true` if a valid entry of the given size was found. Entries
+///   that fail their checksum are deleted.
+bool OpenDiskEntry(u64 key, int width, int height, disk_entry_t * entry);
+
+void CloseDiskEntry(disk_entry_t * entry);
+
+/// Lookups by `OpenDiskEntry()` while the disk cache was enabled.
+disk_cache_stats_t DiskCacheStats(void);
+
+/// Write a world's field and classes to the cache and evict the least
+/// recently used entries if the cache is now over budget.
+/// Safe to call from any thread, and from several at once.
+void StoreDiskEntry
+(   u64 key,
+    int width,
+    int height,
+    const float * field,
+    const u8 * classes );
+
+#endif /* __DISKCACHE_H__ */
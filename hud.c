@@ -0,0 +1,269 @@
+#include "hud.h"
+#include "cache.h"
+#include "diskcache.h"
+#include "ui.h"
+#include "mylib/mathlib.h"
+#include "mylib/text.h"
+#include "mylib/video.h"
+
+#include <stdarg.h>
+
+#define HUD_COLUMNS 32 // characters per line of text
+#define MAX_HUD_TEXT 1024
+#define GRAPH_HEIGHT 64 // pixels
+#define GRAPH_MAX_MS 33.3 // frame time at the top of the graph
+#define FRAME_BUDGET_MS 16.7 // frames over this are drawn red
+#define UTILIZATION_INTERVAL_MS 500 // how often worker use is measured
+
+static u64 frame_times[HUD_FRAMES]; // oldest first, from `first_frame`
+static int first_frame;
+static int num_frames;
+static u64 frame_start;
+
+// counted at the start of each frame, so the HUD's own draw calls are left
+// out of the next one
+static u64 frame_batch_calls;
+static u64 frame_texture_draws;
+static int frame_text_calls;
+
+static u64 hud_ns; // the last DrawHud()
+
+// worker busy time is measured over an interval, a frame is too short
+static u64 sample_start;
+static u64 sample_busy_ns;
+static int utilization; // percent
+
+static int CompareTimes(const void * a, const void * b)
+{
+    u64 t1 = *(const u64 *)a;
+    u64 t2 = *(const u64 *)b;
+
+    return (t1 > t2) - (t1 < t2);
+}
+
+// Nearest rank percentile of `count` sorted frame times, in ms.
+static double Percentile(const u64 * sorted, int count, int percent)
+{
+    int rank = (count * percent + 99) / 100;
+
+    return NsToMs(sorted[MAX(rank, 1) - 1]);
+}
+
+// "67%", or "-" if nothing was looked up.
+static const char * HitRate(int hits, int misses)
+{
+    if ( hits + misses == 0 ) {
+        return "-";
+    }
+
+    return ArenaPrintf(&frame_arena, "%d%%", 100 * hits / (hits + misses));
+}
+
+// Add a line to the HUD's text.
+static void Line(char * text, const char * format, ...)
+{
+    size_t len = strlen(text);
+    if ( len >= MAX_HUD_TEXT - 1 ) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text + len, MAX_HUD_TEXT - len - 1, format, args);
+    va_end(args);
+
+    strcat(text, "\n");
+}
+
+static void UpdateUtilization(void)
+{
+    u64 now = Now();
+    task_pool_stats_t pool = TaskPoolStats();
+    u64 elapsed = now - sample_start;
+
+    if ( sample_start == 0 || elapsed > 4 * UTILIZATION_INTERVAL_MS * NS_PER_MS ) {
+        // just shown, or it wasn't drawn for a while: start over
+        sample_start = now;
+        sample_busy_ns = pool.busy_ns;
+        return;
+    }
+
+    if ( elapsed >= UTILIZATION_INTERVAL_MS * NS_PER_MS && pool.workers > 0 ) {
+        utilization = 100 * (pool.busy_ns - sample_busy_ns) / (elapsed * pool.workers);
+        sample_start = now;
+        sample_busy_ns = pool.busy_ns;
+    }
+}
+
+static void DrawGraph(int x, int y)
+{
+    double scale = GRAPH_HEIGHT / GRAPH_MAX_MS;
+
+    // all bars of a color in a row, so they're batched together
+    for ( int pass = 0; pass < 2; pass++ ) {
+        if ( pass == 0 ) {
+            SetRGBA(90, 200, 90, 255);
+        } else {
+            SetRGBA(255, 100, 100, 255);
+        }
+
+        for ( int i = 0; i < num_frames; i++ ) {
+            double ms = NsToMs(frame_times[(first_frame + i) % HUD_FRAMES]);
+            if ( (ms > FRAME_BUDGET_MS) != (pass == 1) ) {
+                continue;
+            }
+
+            int h = MIN(ms * scale, GRAPH_HEIGHT);
+            FillRect((SDL_Rect){ x + i, y + GRAPH_HEIGHT - h, 1, MAX(h, 1) });
+        }
+    }
+
+    SetRGBA(255, 255, 100, 255);
+    int budget_y = y + GRAPH_HEIGHT - FRAME_BUDGET_MS * scale;
+    FillRect((SDL_Rect){ x, budget_y, HUD_FRAMES, 1 });
+}
+
+#pragma mark - PUBLIC FUNCTIONS
+
+void BeginHudFrame(void)
+{
+    batch_stats_t batch = BatchStats();
+
+    frame_start = Now();
+    frame_batch_calls = batch.draw_calls;
+    frame_texture_draws = batch.texture_draws;
+    frame_text_calls = TextDrawCalls();
+}
+
+void EndHudFrame(void)
+{
+    u64 ns = Now() - frame_start;
+
+    if ( num_frames < HUD_FRAMES ) {
+        frame_times[(first_frame + num_frames++) % HUD_FRAMES] = ns;
+    } else {
+        frame_times[first_frame] = ns;
+        first_frame = (first_frame + 1) % HUD_FRAMES;
+    }
+}
+
+int HudWidth(void)
+{
+    float scale_x, scale_y;
+    GetTextScale(&scale_x, &scale_y);
+    SetTextScale(1.0f, 1.0f);
+
+    int w = MAX(HUD_FRAMES, HUD_COLUMNS * CharWidth()) + LABEL_MARGIN * 2;
+
+    SetTextScale(scale_x, scale_y);
+    return w;
+}
+
+void DrawHud(int x, int y, const task_graph_t * graph)
+{
+    u64 start = Now();
+
+    // this frame's draw calls so far
+    FlushBatch();
+    batch_stats_t batch = BatchStats();
+    int texture_draws = batch.texture_draws - frame_texture_draws;
+    int text_calls = TextDrawCalls() - frame_text_calls;
+    int draw_calls = batch.draw_calls - frame_batch_calls + texture_draws + text_calls;
+
+    UpdateUtilization();
+
+    char * text = ArenaAlloc(&frame_arena, MAX_HUD_TEXT);
+    text[0] = '\0';
+
+    //
+    // frame times
+    //
+    if ( num_frames > 0 ) {
+        u64 sorted[HUD_FRAMES];
+        for ( int i = 0; i < num_frames; i++ ) {
+            sorted[i] = frame_times[i];
+        }
+        qsort(sorted, num_frames, sizeof(*sorted), CompareTimes);
+
+        int last = (first_frame + num_frames - 1) % HUD_FRAMES;
+        Line(text, "Frame %.2f ms (HUD %.2f ms)",
+             NsToMs(frame_times[last]),
+             NsToMs(hud_ns));
+        Line(text, "p50 %.2f  p95 %.2f  p99 %.2f",
+             Percentile(sorted, num_frames, 50),
+             Percentile(sorted, num_frames, 95),
+             Percentile(sorted, num_frames, 99));
+    }
+
+    //
+    // generation stages
+    //
+    if ( graph && graph->tiles > 0 ) {
+        u64 total = 0;
+        for ( int i = 0; i < graph->num_nodes; i++ ) {
+            total += graph->nodes[i].ns;
+        }
+
+        Line(text, "%d tiles, %.2f ms wall", graph->tiles, NsToMs(graph->wall_ns));
+
+        for ( int i = 0; i < graph->num_nodes; i++ ) {
+            const graph_node_t * node = &graph->nodes[i];
+            Line(text, "  %-10s %8.2f ms %3d%%",
+                 node->name,
+                 NsToMs(node->ns),
+                 total ? (int)(100 * node->ns / total) : 0);
+        }
+    }
+
+    //
+    // rendering and caches
+    //
+    texture_pool_stats_t textures = TexturePoolStats();
+    cache_stats_t worlds = CacheStats();
+    disk_cache_stats_t disk = DiskCacheStats();
+    ui_stats_t ui = UIStats();
+
+    Line(text, "Draw calls %d (%d tex, %d text)", draw_calls, texture_draws, text_calls);
+    Line(text, "Textures %.1f MB, %d in use",
+         (textures.in_use_bytes + textures.bytes) / (1024.0 * 1024.0),
+         textures.in_use);
+    Line(text, "Hits: world %s  disk %s",
+         HitRate(worlds.hits, worlds.misses),
+         HitRate(disk.hits, disk.misses));
+    Line(text, "  labels %s  textures %s",
+         HitRate(ui.hits, ui.misses),
+         HitRate(textures.hits, textures.misses));
+
+    task_pool_stats_t pool = TaskPoolStats();
+    Line(text, "Workers %d, %d%% busy", pool.workers, utilization);
+
+    //
+    // draw it
+    //
+    float scale_x, scale_y;
+    GetTextScale(&scale_x, &scale_y);
+    SetTextScale(1.0f, 1.0f);
+
+    int lines = 0;
+    for ( const char * c = text; *c; c++ ) {
+        lines += *c == '\n';
+    }
+
+    int w = HudWidth() - LABEL_MARGIN;
+    int text_h = lines * CharHeight();
+    int h = text_h + GRAPH_HEIGHT + LABEL_MARGIN * 2;
+
+    // a box like a label's
+    SetGray(0);
+    FillRect((SDL_Rect){ x + LABEL_MARGIN, y + LABEL_MARGIN, w, h });
+    SetGray(32);
+    FillRect((SDL_Rect){ x, y, w, h });
+
+    DrawGraph(x + LABEL_MARGIN, y + LABEL_MARGIN + text_h);
+
+    SetRGBA(248, 248, 248, 255);
+    Print(x + LABEL_MARGIN, y + LABEL_MARGIN, "%s", text);
+
+    SetTextScale(scale_x, scale_y);
+    hud_ns = Now() - start;
+}
@@ -0,0 +1,38 @@
+// -----------------------------------------------------------------------------
+//  Performance HUD
+//
+//  An overlay of the numbers worth watching while tweaking: a graph of
+//  recent frame times and their percentiles, where the generation stages'
+//  time went, draw calls, texture memory, cache hit rates, and how busy
+//  the task workers are.
+//
+//  Frame times are recorded whether or not the HUD is shown, which costs
+//  two `Now()`s a frame. Everything else is only gathered while drawing
+//  it. The text is a single `Print()` rather than cached labels, which
+//  would be rendered again every frame as the numbers change, and the
+//  graph's bars are batched, so the HUD takes a handful of draw calls.
+// -----------------------------------------------------------------------------
+#ifndef __HUD_H__
+#define __HUD_H__
+
+#include "mylib/taskgraph.h"
+
+#define HUD_FRAMES 240 // frame times kept for the graph and percentiles
+
+/// Mark the start of a frame's work, including handling its events but
+/// not waiting for them. Calling it again without `EndHudFrame()` discards
+/// the frame.
+void BeginHudFrame(void);
+
+/// Mark the end of a frame's work, after `Present()`.
+void EndHudFrame(void);
+
+/// Width of what `DrawHud()` draws with the current font.
+int HudWidth(void);
+
+/// Draw the HUD with its top left corner at x, y, in the current font
+/// at 1x scale.
+/// - Parameter graph: The graph whose stages to break down, or `NULL`.
+void DrawHud(int x, int y, const task_graph_t * graph);
+
+#endif /* __HUD_H__ */
@@ -2,9 +2,20 @@
 //  worldtweak
 //  by Thomas Foster
 // -----------------------------------------------------------------------------
+#include "bench.h"
+#include "cache.h"
+#include "chunk.h"
+#include "diskcache.h"
+#include "hud.h"
+#include "mip.h"
+#include "snapshot.h"
 #include "mylib/mathlib.h"
+#include "mylib/profiler.h"
+#include "mylib/taskgraph.h"
 #include "mylib/text.h"
+#include "mylib/timing.h"
 #include "mylib/video.h"
+#include "ui.h"
 
 #include <SDL2/SDL.h>
 
@@ -28,9 +39,118 @@ typedef struct {
 } property_t;
 
 SDL_Texture * world;
-SDL_Texture * background;
+SDL_Texture * background; // BG_TILE_SIZE pattern, tiled over the window
+#define BG_TILE_SIZE 64
+float * field; // world_width * world_height, masked noise values
+u8 * classes; // world_width * world_height, layer index per pixel
 enum { clean, dirty, generating } generation_state;
-int generation_ms; // time GenerateWorld() takes, in milliseconds
+u64 generation_ns; // time GenerateWorld() takes
+bool generation_cached; // the last world came out of the cache
+
+// viewCenter is the world coordinate that should
+// appear centered on screen.
+int viewCenterX;
+int viewCenterY;
+float scale = 2.0f;
+
+// draw an endless world made of chunks instead of the world texture
+bool infinite;
+bool world_stale; // world texture is out of date, regenerate when shown
+
+// When zoomed in at least this far, regenerate what's on screen at screen
+// resolution and draw it over the magnified world.
+#define DETAIL_SCALE 4.0f
+bool detail = true;
+
+//
+// tiled generation
+// The world is generated in square tiles. In viewport-first mode, tiles on
+// screen are generated right away and the rest are filled in a bit at a
+// time by the main loop. Tiles whose classes change are marked dirty and
+// only those are uploaded to the world texture.
+//
+
+#define TILE_SIZE 64
+#define TILE_MARGIN 1 // extra tiles around the view to generate first
+#define FILL_BUDGET_MS 8 // per frame, for filling in off-screen tiles
+#define MIN_SCALE (1.0f / (1 << MAX_MIP_LEVELS))
+
+bool viewport_first = true;
+int tiles_x;
+int tiles_y;
+int tiles_remaining;
+bool * tile_done; // tiles_x * tiles_y
+int * tile_order; // tile indices nearest the view center first
+int tile_cursor; // position in tile_order of the next tile to check
+bool * tile_dirty; // tiles_x * tiles_y, classes changed since last upload
+int upload_bytes; // uploaded to the world texture so far this frame
+int last_upload_bytes; // in the most recent frame that uploaded anything
+
+// noise -> mask -> classify -> colorize -> upload, see the generation stages
+task_graph_t generation_graph;
+u32 ** tile_pixels; // tiles_x * tiles_y, colorized tiles waiting for upload
+bool stage_timings; // --stage-timings: print them when a world is done
+bool whole_world; // generating every tile in one run: upload them together
+
+// FieldKey() of the values in `field`, or 0 if it's incomplete
+u64 field_key;
+
+// `field` and `classes` belong to the current world snapshot, and are
+// copied before being changed for the next world
+bool buffers_published;
+
+//
+// disk writer
+// Published worlds are stored in the disk cache by a thread of their own.
+// As a task pool task, a write several megabytes big could be picked up
+// by the main thread while it helps out in RunTaskGraph().
+//
+
+#define MAX_DISK_WRITES 4 // queued worlds, any more aren't stored
+
+SDL_Thread * disk_writer;
+SDL_mutex * disk_lock;
+SDL_cond * disk_wake;
+world_snapshot_t * disk_queue[MAX_DISK_WRITES]; // oldest first
+int disk_queued;
+bool disk_quit; // finish what's queued and stop
+
+//
+// main loop pacing
+// Frames are only drawn when something changed: input, scrolling, window
+// events, or generation that's still in progress. Otherwise the loop
+// blocks waiting for events.
+//
+
+#define IDLE_TIMEOUT_MS 1000 // wake up at least this often while idle
+#define TRACE_PATH "worldtweak-trace.json"
+#define FRAME_DELAY_MS 10 // between frames, when not using vsync
+
+bool vsync; // --vsync: pace frames with the display instead of a delay
+bool software; // --software: draw everything into a CPU framebuffer
+bool redraw = true; // something on screen changed
+u32 frames; // number of frames drawn
+u32 idle_wakeups; // times the loop woke up from waiting for events
+int idle_ms; // time spent waiting for events since the last frame
+int idle_percent; // of the time between the last two frames
+int last_frame_ms;
+bool show_hud; // [H] or --hud
+
+//
+// startup timings
+// Startup is split into phases, each timed from the end of the previous
+// one. With --startup-timings, they're printed after the first frame.
+//
+
+#define MAX_STARTUP_PHASES 8
+
+bool startup_timings;
+int num_startup_phases;
+u64 startup_phase_start;
+struct {
+    const char * name;
+    float ms;
+} startup_phases[MAX_STARTUP_PHASES];
 
 //
 // property list
@@ -79,6 +199,17 @@ property_t properties[] = {
     { "Mask On",            &mask_on,       0,  1       },
 };
 
+//
+// undo history
+//
+
+#define MAX_HISTORY 256
+
+// property values after each edit, oldest first
+float history[MAX_HISTORY][NUM_PROPERTIES];
+int history_count;
+int history_index; // the entry currently shown
+
 // TODO: name and define these colors somewhere
 SDL_Color layer_colors[] = {
     { 0x00, 0x00,  160, 0xFF },
@@ -90,6 +221,15 @@ SDL_Color layer_colors[] = {
     {  248,  248,  248, 0xFF },
 };
 
+// The world is kept as layer indices and only expanded to RGBA8888 with
+// this palette when uploaded, so it can be recolored without regenerating.
+u32 colors[16];
+bool grayscale; // draw layers as shades of gray instead of layer_colors
+
+ui_panel_t property_panel;
+
+_Static_assert(NUM_LAYERS <= 16, "layer indices must fit the palette");
+
 SDL_Rect GetWindowSize(void)
 {
     window_info_t info = WindowInfo();
@@ -102,72 +242,862 @@ float Distance(float x1, float y1, float x2, float y2) {
     return sqrtf(dx*dx + dy*dy);
 }
 
-// draw pixels to world texture based on noise value and layer elevations
-void GenerateWorld(void)
+// a hash of all property values
+u64 ParameterKey(void)
 {
-    if ( world != NULL ) {
-        SDL_DestroyTexture(world);
-        world = NULL;
+    u64 key = FNV_OFFSET;
+
+    for ( int i = 0; i < NUM_PROPERTIES; i++ ) {
+        key = HashBytes(properties[i].value, sizeof(float), key);
     }
 
-    world = SDL_CreateTexture
-    (   renderer,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        world_width, world_height );
+    return key;
+}
 
-    if ( world == NULL ) {
-        puts("failed to create world texture!");
-        exit(1);
+// a hash of the property values that affect the noise field, i.e. all but
+// the layer thresholds
+u64 FieldKey(void)
+{
+    u64 key = FNV_OFFSET;
+
+    for ( int i = 0; i < NUM_PROPERTIES; i++ ) {
+        float * value = properties[i].value;
+        if ( value < layers || value >= layers + NUM_LAYERS ) {
+            key = HashBytes(value, sizeof(float), key);
+        }
     }
 
-    SDL_SetTextureBlendMode(world, SDL_BLENDMODE_BLEND);
+    return key;
+}
 
-    SDL_SetRenderTarget(renderer, world);
-    SetGray(0);
-    Clear();
+// a hash of everything that affects the field and classes, for the disk
+// cache, which must also be invalidated by changes to the noise itself
+// - Parameter key: The world's ParameterKey().
+u64 DiskKey(u64 key)
+{
+    u32 version = NOISE_VERSION;
+    return HashBytes(&version, sizeof(version), key);
+}
 
-    int ms = SDL_GetTicks();
+u32 PackColor(SDL_Color color)
+{
+    return (u32)color.r << 24 | (u32)color.g << 16 | (u32)color.b << 8 | color.a;
+}
 
-    RandomizeNoise((int)world_seed);
+// unmasked noise value at world coordinate x, y
+float NoiseValue(float x, float y)
+{
+    float z = 1.0f;
+    return Noise2(x,
+                  y,
+                  z,
+                  frequency,
+                  octaves,
+                  amplitude,
+                  persistence,
+                  lacunarity);
+}
+
+// how much the island mask lowers the noise at world coordinate x, y, or -1
+// if it's outside the island
+float MaskGradient(float x, float y)
+{
+    float dist = Distance(x, y, world_height / 2, world_height / 2);
+
+    if ( dist < world_height / 2 ) {
+        return mask_on
+        ? MAP(dist, 0.0f, world_height / 2.0f, 0.0f, 1.0f)
+        : 0;
+    }
+
+    return -1.0f;
+}
+
+// noise value at world coordinate x, y with the island mask applied
+float FieldValue(float x, float y)
+{
+    float gradient = MaskGradient(x, y);
+
+    if ( gradient < 0 ) {
+        return -1.0f;
+    }
+
+    return NoiseValue(x, y) - gradient;
+}
 
-    for ( int y = 0; y < world_height; y++ ) {
-        for ( int x = 0; x < world_width; x++ ) {
-
-            float dist = Distance(x, y, world_height / 2, world_height / 2);
-
-            float gradient;
-            float noise;
-            float z = 1.0f;
-            if ( dist < world_height / 2 ) {
-                gradient = mask_on
-                ? MAP(dist, 0.0f, world_height / 2.0f, 0.0f, 1.0f)
-                : 0;
-                noise = Noise2(x,
-                               y,
-                               z,
-                               frequency,
-                               octaves,
-                               amplitude,
-                               persistence,
-                               lacunarity) - gradient;
+// layer index for a field value
+int Classify(float value)
+{
+    for ( int i = 0; i < NUM_LAYERS - 1; i++ ) {
+        if ( value < layers[i + 1] ) {
+            return i;
+        }
+    }
+
+    return NUM_LAYERS - 1;
+}
+
+// chunk_generator_t, called from chunk worker threads. In infinite mode
+// there's no island mask since there's no edge to fade out to. Otherwise
+// these are detail chunks laid over the world texture, transparent
+// outside the world.
+void GenerateChunkClasses
+(   float x,
+    float y,
+    float step,
+    int w,
+    int h,
+    u8 * out )
+{
+    ZONE("GenerateChunkClasses");
+
+    for ( int row = 0; row < h; row++ ) {
+        for ( int col = 0; col < w; col++ ) {
+            float wx = x + col * step;
+            float wy = y + row * step;
+
+            if ( infinite ) {
+                *out++ = Classify(NoiseValue(wx, wy));
+            } else if ( wx < 0 || wy < 0
+                       || wx >= world_width || wy >= world_height ) {
+                *out++ = 0xFF; // transparent
             } else {
-                noise = -1.0f;
+                *out++ = Classify(FieldValue(wx, wy));
+            }
+        }
+    }
+}
+
+// the part of the world that is currently on screen, in world pixels
+SDL_Rect VisibleRect(void)
+{
+    SDL_Rect win = GetWindowSize();
+    float half_w = (win.w / 2) / scale;
+    float half_h = (win.h / 2) / scale;
+
+    int x0 = MAX(floorf(viewCenterX - half_w), 0);
+    int y0 = MAX(floorf(viewCenterY - half_h), 0);
+    int x1 = MIN(ceilf(viewCenterX + half_w), (int)world_width);
+    int y1 = MIN(ceilf(viewCenterY + half_h), (int)world_height);
+
+    return (SDL_Rect){ x0, y0, MAX(x1 - x0, 0), MAX(y1 - y0, 0) };
+}
+
+SDL_Rect TileRect(int tile)
+{
+    SDL_Rect rect = {
+        .x = (tile % tiles_x) * TILE_SIZE,
+        .y = (tile / tiles_x) * TILE_SIZE,
+    };
+    rect.w = MIN(TILE_SIZE, (int)world_width - rect.x);
+    rect.h = MIN(TILE_SIZE, (int)world_height - rect.y);
+
+    return rect;
+}
+
+//
+// generation stages
+// Each tile goes through these in order, as the nodes of a task graph: a
+// tile's next stage can start as soon as its last one is done, so early
+// tiles are being classified while later ones are still getting noise.
+// More passes over a tile can be added as nodes with the same parent.
+// Everything but the upload runs on the task pool. When the whole world
+// is made in one run, tiles are just marked dirty instead, and
+// FlushDirtyTiles() uploads them in a single call.
+//
+
+// unmasked noise, or -1 outside the island, where there's no need for it
+void NoiseStage(int tile, void * data)
+{
+    (void)data;
+    SDL_Rect r = TileRect(tile);
+    int w = world_width;
+
+    for ( int y = r.y; y < r.y + r.h; y++ ) {
+        for ( int x = r.x; x < r.x + r.w; x++ ) {
+            bool outside = MaskGradient(x, y) < 0;
+            field[y * w + x] = outside ? -1.0f : NoiseValue(x, y);
+        }
+    }
+}
+
+// turn the noise into FieldValue()
+void MaskStage(int tile, void * data)
+{
+    (void)data;
+    SDL_Rect r = TileRect(tile);
+    int w = world_width;
+
+    for ( int y = r.y; y < r.y + r.h; y++ ) {
+        for ( int x = r.x; x < r.x + r.w; x++ ) {
+            float gradient = MaskGradient(x, y);
+            if ( gradient >= 0 ) {
+                field[y * w + x] -= gradient;
+            }
+        }
+    }
+}
+
+void ClassifyStage(int tile, void * data)
+{
+    (void)data;
+    SDL_Rect r = TileRect(tile);
+    int w = world_width;
+
+    for ( int y = r.y; y < r.y + r.h; y++ ) {
+        for ( int x = r.x; x < r.x + r.w; x++ ) {
+            int i = y * w + x;
+            classes[i] = Classify(field[i]);
+        }
+    }
+}
+
+// expand the tile's classes into a buffer of pixels, ready for uploading
+void ColorizeStage(int tile, void * data)
+{
+    (void)data;
+
+    if ( whole_world ) {
+        return; // FlushDirtyTiles() expands them all in one upload
+    }
+
+    SDL_Rect r = TileRect(tile);
+    int w = world_width;
+
+    u32 * pixels = MemAlloc(MEM_GENERATION, r.w * r.h * sizeof(*pixels));
+    if ( pixels == NULL ) {
+        Error("out of memory");
+    }
+
+    for ( int y = 0; y < r.h; y++ ) {
+        const u8 * src = &classes[(r.y + y) * w + r.x];
+        ExpandPalette(src, &pixels[y * r.w], r.w, colors);
+    }
+
+    tile_pixels[tile] = pixels;
+}
+
+// main thread only: the renderer isn't thread safe
+void UploadStage(int tile, void * data)
+{
+    (void)data;
+
+    if ( tile_pixels[tile] ) {
+        SDL_Rect r = TileRect(tile);
+        SDL_UpdateTexture(world, &r, tile_pixels[tile], r.w * sizeof(u32));
+        upload_bytes += r.w * r.h * sizeof(u32);
+        MemFree(tile_pixels[tile]);
+        tile_pixels[tile] = NULL;
+        tile_dirty[tile] = false;
+    } else {
+        tile_dirty[tile] = true; // not colorized, see ColorizeStage()
+    }
+
+    tile_done[tile] = true;
+    tiles_remaining--;
+}
+
+void InitGenerationGraph(void)
+{
+    task_graph_t * graph = &generation_graph;
+    InitTaskGraph(graph, NULL);
+
+    int noise = AddGraphNode(graph, "noise", NoiseStage, -1, false);
+    int mask = AddGraphNode(graph, "mask", MaskStage, noise, false);
+    int classify = AddGraphNode(graph, "classify", ClassifyStage, mask, false);
+    int colorize = AddGraphNode(graph, "colorize", ColorizeStage, classify, false);
+    AddGraphNode(graph, "upload", UploadStage, colorize, true);
+}
+
+// Copy a whole world's classes, marking only the tiles that differ as dirty.
+void ReplaceClasses(const u8 * new_classes)
+{
+    int w = world_width;
+
+    for ( int tile = 0; tile < tiles_x * tiles_y; tile++ ) {
+        SDL_Rect r = TileRect(tile);
+
+        for ( int y = r.y; y < r.y + r.h; y++ ) {
+            u8 * dst = &classes[y * w + r.x];
+            const u8 * src = &new_classes[y * w + r.x];
+
+            if ( memcmp(dst, src, r.w * sizeof(*dst)) != 0 ) {
+                memcpy(dst, src, r.w * sizeof(*dst));
+                tile_dirty[tile] = true;
             }
+        }
+    }
+}
+
+// Reclassify `field`, e.g. because only the layer thresholds changed,
+// marking only the tiles that differ as dirty.
+void ReclassifyTiles(void)
+{
+    int w = world_width;
+
+    for ( int tile = 0; tile < tiles_x * tiles_y; tile++ ) {
+        SDL_Rect r = TileRect(tile);
 
-            for ( int i = 0; i < NUM_LAYERS - 1; i++ ) {
-                if ( noise < layers[i + 1] ) {
-                    SetColor(layer_colors[i]);
-                    break;
+        for ( int y = r.y; y < r.y + r.h; y++ ) {
+            for ( int x = r.x; x < r.x + r.w; x++ ) {
+                int i = y * w + x;
+                u8 layer = Classify(field[i]);
+
+                if ( classes[i] != layer ) {
+                    classes[i] = layer;
+                    tile_dirty[tile] = true;
                 }
             }
+        }
+    }
+}
+
+// Upload tiles that changed since the last call, or the whole texture in
+// one go if they all did.
+void FlushDirtyTiles(void)
+{
+    ZONE("FlushDirtyTiles");
+
+    int num_tiles = tiles_x * tiles_y;
+    int num_dirty = 0;
+
+    for ( int i = 0; i < num_tiles; i++ ) {
+        num_dirty += tile_dirty[i];
+    }
+
+    if ( num_dirty == num_tiles ) {
+        UpdateTextureIndexed(world, NULL, classes, world_width, colors);
+        upload_bytes += world_width * world_height * sizeof(u32);
+        memset(tile_dirty, 0, num_tiles * sizeof(*tile_dirty));
+    } else if ( num_dirty > 0 ) {
+        for ( int i = 0; i < num_tiles; i++ ) {
+            if ( tile_dirty[i] ) {
+                SDL_Rect r = TileRect(i);
+                const u8 * src = &classes[r.y * (int)world_width + r.x];
+                UpdateTextureIndexed(world, &r, src, world_width, colors);
+                upload_bytes += r.w * r.h * sizeof(u32);
+                tile_dirty[i] = false;
+            }
+        }
+    }
+
+    // this includes tiles uploaded by generation earlier in the frame
+    if ( upload_bytes > 0 ) {
+        last_upload_bytes = upload_bytes;
+        upload_bytes = 0;
+    }
+}
+
+// Make the finished world the current snapshot, for readers on other
+// threads. Its buffers belong to the snapshot from now on.
+void PublishWorld(void)
+{
+    float parameters[NUM_PROPERTIES];
+    for ( int i = 0; i < NUM_PROPERTIES; i++ ) {
+        parameters[i] = *properties[i].value;
+    }
+
+    world_snapshot_t * snapshot = NewSnapshot
+    (   ParameterKey(),
+        field_key,
+        world_width,
+        world_height,
+        field,
+        classes,
+        parameters,
+        NUM_PROPERTIES );
+
+    PublishSnapshot(snapshot);
+    buffers_published = true;
+}
+
+// Before changing `field` or `classes` for a new world of size w, h, give
+// the published ones back to the snapshot and carry on with copies: the
+// dirty tile checks and ReclassifyTiles() compare against the old world.
+void CopyPublishedBuffers(int w, int h)
+{
+    if ( !buffers_published ) {
+        return;
+    }
+
+    world_snapshot_t * published = AcquireSnapshot();
+    size_t count = (size_t)w * h;
+
+    if ( published->width != w || published->height != h ) {
+        // nothing to compare against, ResizeWorld() makes new ones
+        field = NULL;
+        classes = NULL;
+    } else {
+        field = MemAlloc(MEM_GENERATION, count * sizeof(*field));
+        classes = MemAlloc(MEM_GENERATION, count * sizeof(*classes));
+        if ( field == NULL || classes == NULL ) {
+            puts("failed to allocate world buffers!");
+            exit(1);
+        }
+
+        memcpy(field, published->field, count * sizeof(*field));
+        memcpy(classes, published->classes, count * sizeof(*classes));
+    }
+
+    ReleaseSnapshot(published);
+    buffers_published = false;
+}
+
+int DiskWriter(void * data)
+{
+    (void)data;
+    SetProfilerThreadName("disk writer");
+
+    SDL_LockMutex(disk_lock);
+
+    while ( 1 ) {
+        while ( disk_queued == 0 && !disk_quit ) {
+            SDL_CondWait(disk_wake, disk_lock);
+        }
+
+        if ( disk_queued == 0 ) {
+            break; // quitting, and everything's written
+        }
+
+        world_snapshot_t * snapshot = disk_queue[0];
+        disk_queued--;
+        memmove(disk_queue, disk_queue + 1, disk_queued * sizeof(*disk_queue));
+        SDL_UnlockMutex(disk_lock);
+
+        StoreDiskEntry
+        (   DiskKey(snapshot->key),
+            snapshot->width,
+            snapshot->height,
+            snapshot->field,
+            snapshot->classes );
+
+        ReleaseSnapshot(snapshot);
+        SDL_LockMutex(disk_lock);
+    }
+
+    SDL_UnlockMutex(disk_lock);
+
+    return 0;
+}
+
+void StartDiskWriter(void)
+{
+    disk_lock = SDL_CreateMutex();
+    disk_wake = SDL_CreateCond();
+    disk_writer = SDL_CreateThread(DiskWriter, "disk writer", NULL);
+
+    if ( disk_lock == NULL || disk_wake == NULL || disk_writer == NULL ) {
+        Error("could not start disk writer thread (%s)", SDL_GetError());
+    }
+}
+
+// Write everything that's queued, then stop the thread.
+void StopDiskWriter(void)
+{
+    SDL_LockMutex(disk_lock);
+    disk_quit = true;
+    SDL_CondSignal(disk_wake);
+    SDL_UnlockMutex(disk_lock);
+
+    SDL_WaitThread(disk_writer, NULL);
+    SDL_DestroyCond(disk_wake);
+    SDL_DestroyMutex(disk_lock);
+}
+
+// Store a snapshot in the disk cache, taking over the reference to it.
+void QueueDiskWrite(world_snapshot_t * snapshot)
+{
+    bool queued = false;
+
+    SDL_LockMutex(disk_lock);
+    if ( disk_queued < MAX_DISK_WRITES ) {
+        disk_queue[disk_queued++] = snapshot;
+        queued = true;
+        SDL_CondSignal(disk_wake);
+    }
+    SDL_UnlockMutex(disk_lock);
+
+    if ( !queued ) {
+        ReleaseSnapshot(snapshot); // the writer is behind, skip this one
+    }
+}
+
+// the whole world is generated: save it
+void FinishGeneration(void)
+{
+    int w = world_width;
+    int h = world_height;
 
-            DrawPoint(x, y);
+    if ( stage_timings && generation_graph.tiles > 0 ) {
+        PrintGraphTimings(&generation_graph, stdout);
+    }
+
+    field_key = FieldKey();
+    PublishWorld();
+    QueueDiskWrite(AcquireSnapshot());
+    CacheWorld(ParameterKey(), classes, w, h);
+    BuildMipPyramid(classes, w, h, colors);
+}
+
+// Fill in a mip level by sampling the noise at the center of each of its
+// texels. This is 1/4^level the work of the full world, so a zoomed-out
+// view can be shown before the world is done.
+void GenerateMipLevel(int level)
+{
+    ZONE("GenerateMipLevel");
+
+    int w, h;
+    MipLevelSize(level, world_width, world_height, &w, &h);
+    int size = 1 << level;
+
+    arena_mark_t mark = ArenaMark(&frame_arena);
+    u8 * level_classes = ArenaAlloc(&frame_arena, w * h * sizeof(*level_classes));
+
+    for ( int y = 0; y < h; y++ ) {
+        for ( int x = 0; x < w; x++ ) {
+            int wx = MIN(x * size + size / 2, (int)world_width - 1);
+            int wy = MIN(y * size + size / 2, (int)world_height - 1);
+            level_classes[y * w + x] = Classify(FieldValue(wx, wy));
         }
     }
 
-    generation_ms = SDL_GetTicks() - ms;
-    SDL_SetRenderTarget(renderer, NULL);
+    SetMipLevel(level, level_classes, world_width, world_height, colors);
+    ArenaRelease(&frame_arena, mark);
+}
+
+// Generate tiles on screen, then those nearest the view center, until
+// `budget_ms` has elapsed.
+void ContinueGeneration(int budget_ms)
+{
+    if ( tiles_remaining == 0 ) {
+        return;
+    }
+
+    u64 start = Now();
+
+    // When zoomed out, the view is drawn from a mip level and doesn't need
+    // any full-size tiles right away.
+    SDL_Rect view = VisibleRect();
+    if ( MipLevel(MipLevelForScale(scale))->texture ) {
+        view.w = view.h = 0;
+    }
+
+    int tx0 = MAX(view.x / TILE_SIZE - TILE_MARGIN, 0);
+    int ty0 = MAX(view.y / TILE_SIZE - TILE_MARGIN, 0);
+    int tx1 = MIN((view.x + view.w - 1) / TILE_SIZE + TILE_MARGIN, tiles_x - 1);
+    int ty1 = MIN((view.y + view.h - 1) / TILE_SIZE + TILE_MARGIN, tiles_y - 1);
+
+    arena_mark_t mark = ArenaMark(&frame_arena);
+    int * batch = ArenaAlloc(&frame_arena, tiles_x * tiles_y * sizeof(*batch));
+    int count = 0;
+
+    for ( int ty = ty0; ty <= ty1; ty++ ) {
+        for ( int tx = tx0; tx <= tx1; tx++ ) {
+            int tile = ty * tiles_x + tx;
+            if ( !tile_done[tile] ) {
+                batch[count++] = tile;
+            }
+        }
+    }
+
+    RunTaskGraph(&generation_graph, batch, count);
+
+    // The rest goes in small batches, so as not to overshoot the budget by
+    // much, but big enough to keep every worker busy.
+    int batch_size = 2 * (TaskPoolStats().workers + 1);
+
+    while ( tiles_remaining > 0 && Now() - start < budget_ms * NS_PER_MS ) {
+        count = 0;
+        while ( count < batch_size && tile_cursor < tiles_x * tiles_y ) {
+            int tile = tile_order[tile_cursor++];
+            if ( !tile_done[tile] ) {
+                batch[count++] = tile;
+            }
+        }
+
+        RunTaskGraph(&generation_graph, batch, count);
+    }
+
+    ArenaRelease(&frame_arena, mark);
+
+    generation_ns += Now() - start;
+
+    if ( tiles_remaining == 0 ) {
+        FinishGeneration();
+    }
+}
+
+static int tile_dist_cx;
+static int tile_dist_cy;
+
+static int TileDistance(int tile)
+{
+    SDL_Rect r = TileRect(tile);
+    int dx = r.x + r.w / 2 - tile_dist_cx;
+    int dy = r.y + r.h / 2 - tile_dist_cy;
+
+    return dx * dx + dy * dy;
+}
+
+static int CompareTileDistance(const void * a, const void * b)
+{
+    return TileDistance(*(const int *)a) - TileDistance(*(const int *)b);
+}
+
+// reset tile bookkeeping for a new world, with generation order sorted by
+// distance from the current view center
+void StartTiles(void)
+{
+    int num_tiles = tiles_x * tiles_y;
+
+    field_key = 0;
+
+    for ( int i = 0; i < num_tiles; i++ ) {
+        tile_done[i] = false;
+        tile_order[i] = i;
+    }
+
+    tile_dist_cx = viewCenterX;
+    tile_dist_cy = viewCenterY;
+    qsort(tile_order, num_tiles, sizeof(*tile_order), CompareTileDistance);
+
+    tile_cursor = 0;
+    tiles_remaining = num_tiles;
+    ResetGraphTimings(&generation_graph);
+}
+
+// Make the world texture, buffers, and tiles fit a world of size w, h. If
+// the size changed, everything is marked dirty.
+void ResizeWorld(int w, int h)
+{
+    int tex_w = 0;
+    int tex_h = 0;
+
+    if ( world != NULL ) {
+        SDL_QueryTexture(world, NULL, NULL, &tex_w, &tex_h);
+    }
+
+    if ( tex_w == w && tex_h == h ) {
+        return;
+    }
+
+    // The old texture goes back to the pool, so stepping the size back
+    // (or undoing) reuses it.
+    ReleaseTexture(world);
+    world = AcquireTexture
+    (   SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        w, h );
+
+    SDL_SetTextureBlendMode(world, SDL_BLENDMODE_BLEND);
+
+    field = MemRealloc(MEM_GENERATION, field, w * h * sizeof(*field));
+    classes = MemRealloc(MEM_GENERATION, classes, w * h * sizeof(*classes));
+    if ( field == NULL || classes == NULL ) {
+        puts("failed to allocate world buffers!");
+        exit(1);
+    }
+
+    tiles_x = (w + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y = (h + TILE_SIZE - 1) / TILE_SIZE;
+    int num_tiles = tiles_x * tiles_y;
+
+    tile_done = MemRealloc(MEM_GENERATION, tile_done, num_tiles * sizeof(*tile_done));
+    tile_order = MemRealloc(MEM_GENERATION, tile_order, num_tiles * sizeof(*tile_order));
+    tile_dirty = MemRealloc(MEM_GENERATION, tile_dirty, num_tiles * sizeof(*tile_dirty));
+    tile_pixels = MemRealloc(MEM_GENERATION, tile_pixels, num_tiles * sizeof(*tile_pixels));
+    if ( tile_done == NULL || tile_order == NULL || tile_dirty == NULL
+        || tile_pixels == NULL )
+    {
+        puts("failed to allocate tiles!");
+        exit(1);
+    }
+
+    for ( int i = 0; i < num_tiles; i++ ) {
+        tile_dirty[i] = true;
+    }
+
+    tiles_remaining = 0;
+    field_key = 0;
+}
+
+// Fill the palette and recolor everything that's already been generated:
+// the world texture, mip levels, and chunks are all re-expanded from their
+// classes without touching the noise.
+void SetColors(void)
+{
+    memset(colors, 0, sizeof(colors));
+
+    for ( int i = 0; i < NUM_LAYERS; i++ ) {
+        if ( grayscale ) {
+            u8 v = i * 255 / (NUM_LAYERS - 1);
+            colors[i] = PackColor((SDL_Color){ v, v, v, 0xFF });
+        } else {
+            colors[i] = PackColor(layer_colors[i]);
+        }
+    }
+
+    for ( int i = 0; i < tiles_x * tiles_y; i++ ) {
+        tile_dirty[i] = true;
+    }
+
+    RecolorMipPyramid(colors);
+    SetChunkPalette(colors);
+}
+
+// A cached world's classes weren't made with the current noise state, but
+// chunks are; check that they agree, at the middle of the world.
+void CheckChunkClasses(void)
+{
+    int x = world_width / 2;
+    int y = world_height / 2;
+    u8 chunk_class;
+
+    GenerateChunkClasses(x, y, 1.0f, 1, 1, &chunk_class);
+    SDL_assert(chunk_class == classes[y * (int)world_width + x]);
+}
+
+// draw pixels to world texture based on noise value and layer elevations
+void GenerateWorld(void)
+{
+    ZONE("GenerateWorld");
+
+    int w = world_width;
+    int h = world_height;
+
+    // Chunk workers read the noise state; make sure they're idle before
+    // changing it, and drop chunks made with the old one. Callers that
+    // change properties first must do this before that, too.
+    ResetChunks();
+
+    // Chunks are made from live noise, not the field, so it must match
+    // world_seed however this world is found.
+    RandomizeNoise((int)world_seed);
+
+    if ( infinite ) {
+        tiles_remaining = 0;
+        world_stale = true;
+        return;
+    }
+
+    world_stale = false;
+    CopyPublishedBuffers(w, h);
+    ResizeWorld(w, h);
+
+    u64 start = Now();
+
+    tiles_remaining = 0; // abandon any world still being filled in
+
+    u64 key = ParameterKey();
+    const u8 * cached_classes = FindCachedWorld(key, w, h);
+    generation_cached = cached_classes != NULL;
+
+    if ( generation_cached ) {
+        ReplaceClasses(cached_classes);
+        BuildMipPyramid(classes, w, h, colors);
+
+        if ( field_key != FieldKey() ) {
+            field_key = 0; // field is left over from a different world
+        }
+
+        PublishWorld();
+        CheckChunkClasses();
+        generation_ns = Now() - start;
+        return;
+    }
+
+    if ( field_key != 0 && field_key == FieldKey() ) {
+        // Only the layer thresholds changed. No need for noise.
+        ReclassifyTiles();
+        FinishGeneration();
+        generation_ns = Now() - start;
+        return;
+    }
+
+    disk_entry_t entry;
+    generation_cached = OpenDiskEntry(DiskKey(key), w, h, &entry);
+
+    if ( generation_cached ) {
+        memcpy(field, entry.field, w * h * sizeof(*field));
+        ReplaceClasses(entry.classes);
+        CloseDiskEntry(&entry);
+
+        field_key = FieldKey();
+        PublishWorld();
+        CacheWorld(key, classes, w, h);
+        BuildMipPyramid(classes, w, h, colors);
+        CheckChunkClasses();
+        generation_ns = Now() - start;
+        return;
+    }
+
+    StartTiles();
+    ClearMipPyramid();
+
+    int level = MipLevelForScale(scale);
+    if ( viewport_first && level > 0 ) {
+        GenerateMipLevel(level);
+    }
+
+    if ( viewport_first ) {
+        // with no time budget, only what's on screen gets done now
+        generation_ns = 0;
+        ContinueGeneration(0);
+        return;
+    }
+
+    whole_world = true;
+    RunTaskGraph(&generation_graph, tile_order, tiles_x * tiles_y);
+    whole_world = false;
+    FinishGeneration();
+    generation_ns = Now() - start;
+}
+
+// Round a stepped value to the precision it's displayed at, so that stepping
+// right and then left lands on exactly the same float (and the same world
+// cache key) it started from.
+void SnapValue(property_t * p)
+{
+    float factor = powf(10.0f, p->decimal_places);
+    *p->value = roundf(*p->value * factor) / factor + 0.0f; // no -0
+}
+
+// record current property values as the newest history entry, dropping any
+// entries that were undone
+void SaveHistory(void)
+{
+    if ( history_count > 0 ) {
+        history_index++;
+    }
+
+    if ( history_index == MAX_HISTORY ) {
+        memmove(history[0], history[1], sizeof(history[0]) * (MAX_HISTORY - 1));
+        history_index--;
+    }
+
+    for ( int i = 0; i < NUM_PROPERTIES; i++ ) {
+        history[history_index][i] = *properties[i].value;
+    }
+
+    history_count = history_index + 1;
+}
+
+// move through the history by `offset` entries and show that world
+void StepHistory(int offset)
+{
+    int index = history_index + offset;
+
+    if ( index < 0 || index >= history_count ) {
+        return;
+    }
+
+    ResetChunks(); // chunk workers read the properties
+    history_index = index;
+    for ( int i = 0; i < NUM_PROPERTIES; i++ ) {
+        *properties[i].value = history[history_index][i];
+    }
+
+    GenerateWorld();
 }
 
 // user pressed up/down/left/right
@@ -183,12 +1113,18 @@ void ListDirectionKey(dir_t dir)
             selection = MAX(selection - 1, 0);
             break;
         case DIR_RIGHT:
+            ResetChunks(); // chunk workers read the properties
             *p->value += p->step;
+            SnapValue(p);
+            SaveHistory();
             //generation_state = dirty;
             GenerateWorld();
             break;
         case DIR_LEFT:
+            ResetChunks();
             *p->value -= p->step;
+            SnapValue(p);
+            SaveHistory();
             //generation_state = dirty;
             GenerateWorld();
             break;
@@ -199,86 +1135,254 @@ void ListDirectionKey(dir_t dir)
 
 void PrintLabel(int x, int y, const char * format, ...)
 {
-    u8 r, g, b, a; // saved, text color
-    SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
+    SDL_Color color; // text color
+    SDL_GetRenderDrawColor(renderer, &color.r, &color.g, &color.b, &color.a);
 
-    va_list args[2];
-    va_start(args[0], format);
-    va_copy(args[1], args[0]);
+    va_list args;
+    va_start(args, format);
+    char * buffer = ArenaVPrintf(&frame_arena, format, args);
+    va_end(args);
 
-    int len = vsnprintf(NULL, 0, format, args[0]);
-    char * buffer = calloc(len + 1, sizeof(char));
-    vsnprintf(buffer, len + 1, format, args[1]);
-    va_end(args[0]);
-    va_end(args[1]);
+    // drawn with a neat lil box behind the text
+    DrawLabel(x, y, color, buffer);
+}
 
-    // create a neat lil box to go behind the text
-    {
-        int margin = 6;
-        int w = CharWidth() * len + margin * 2;
-        int h = CharHeight() + margin * 2;
-        SDL_Rect background_rect = { x, y, w, h };
+// PrintLabel() for text that changes every frame, which isn't worth caching.
+void PrintDynamicLabel(int x, int y, const char * format, ...)
+{
+    SDL_Color color;
+    SDL_GetRenderDrawColor(renderer, &color.r, &color.g, &color.b, &color.a);
 
-        SetGray(0);
-        FillRect(background_rect);
+    va_list args;
+    va_start(args, format);
+    char * buffer = ArenaVPrintf(&frame_arena, format, args);
+    va_end(args);
 
-        background_rect.x -= margin;
-        background_rect.y -= margin;
-        SetGray(32);
-        FillRect(background_rect);
-    }
+    DrawDynamicLabel(x, y, color, buffer);
+}
 
-    // restore text color
-    SetRGBA(r, g, b, a);
-    Print(x, y, buffer);
+// a hash of everything shown in the property list
+u64 PropertyListKey(void)
+{
+    font_t font = GetFont();
+    float text_scale[2];
+    GetTextScale(&text_scale[0], &text_scale[1]);
 
-    free(buffer);
+    u64 key = HashBytes(&selection, sizeof(selection), ParameterKey());
+    key = HashBytes(&font, sizeof(font), key);
+
+    return HashBytes(text_scale, sizeof(text_scale), key);
 }
 
+// The property list is drawn into a panel that's only redrawn when the
+// selection or a value changes.
 void DrawPropertyList(void)
 {
+    ZONE("DrawPropertyList");
+
     int char_h = CharHeight();
     SDL_Rect win_size = GetWindowSize();
+    u64 key = PropertyListKey();
+
+    if ( property_panel.texture == NULL || property_panel.key != key ) {
+        char text[NUM_PROPERTIES][64];
+        int w = 0;
+        int h = 0;
+
+        for ( int i = 0; i < NUM_PROPERTIES; i++ ) {
+            property_t * p = &properties[i];
+            snprintf
+            (   text[i],
+                sizeof(text[i]),
+                "%s %.*f", p->name, p->decimal_places, *p->value);
+
+            int label_w, label_h;
+            LabelSize(text[i], &label_w, &label_h);
+            w = MAX(w, label_w);
+            h = char_h * i + label_h;
+        }
 
-    for ( int i = 0; i < NUM_PROPERTIES; i++ ) {
-        property_t * p = &properties[i];
+        if ( BeginPanel(&property_panel, key, w + LABEL_MARGIN, h + LABEL_MARGIN) ) {
+            for ( int i = 0; i < NUM_PROPERTIES; i++ ) {
+                property_t * p = &properties[i];
+                SDL_Color color;
+
+                if ( selection == i && *p->value == p->default_value ) {
+                    // highlight it, default value
+                    color = (SDL_Color){ 90, 255, 90, 255 };
+                } else if ( selection == i ) {
+                    // highlight it, normal
+                    color = (SDL_Color){ 255, 100, 100, 255 };
+                } else {
+                    color = (SDL_Color){ 248, 248, 248, 255 };
+                }
 
-        if ( selection == i && *p->value == p->default_value ) {
-            SetRGBA(90, 255, 90, 255); // highlight it, default value
-        } else if ( selection == i ) {
-            SetRGBA(255, 100, 100, 255); // highlight it, normal
-        } else {
-            SetGray(248);
+                DrawLabel(LABEL_MARGIN, LABEL_MARGIN + char_h * i, color, text[i]);
+            }
+
+            EndPanel(&property_panel);
         }
+    }
 
-        PrintLabel
-        (   win_size.w - 350,
-            (char_h * i) + 16,
-            "%s %.*f", p->name, p->decimal_places, *p->value);
+    DrawPanel
+    (   &property_panel,
+        win_size.w - 350 - LABEL_MARGIN,
+        16 - LABEL_MARGIN );
+}
+
+// Draw the part of the world that's on screen, from the mip level that
+// matches the current zoom.
+void DrawWorld(void)
+{
+    FlushDirtyTiles();
+
+    SDL_Rect win = GetWindowSize();
+    SDL_Rect visible = VisibleRect();
+    SDL_Texture * texture = world;
+
+    int level = MipLevelForScale(scale);
+    if ( level > 0 && MipLevel(level)->texture == NULL && tiles_remaining ) {
+        GenerateMipLevel(level); // zoomed out while the world is unfinished
+    }
+
+    // fall back to a more detailed level if this one isn't there
+    while ( level > 0 && MipLevel(level)->texture == NULL ) {
+        level--;
+    }
+
+    if ( level > 0 ) {
+        texture = MipLevel(level)->texture;
+    }
+
+    // visible rect in level texels, rounded outward
+    int size = 1 << level;
+    int x0 = visible.x / size;
+    int y0 = visible.y / size;
+    int x1 = (visible.x + visible.w + size - 1) / size;
+    int y1 = (visible.y + visible.h + size - 1) / size;
+
+    SDL_Rect src = { x0, y0, x1 - x0, y1 - y0 };
+    SDL_Rect dst = {
+        .x = (win.w / 2) + (src.x * size - viewCenterX) * scale,
+        .y = (win.h / 2) + (src.y * size - viewCenterY) * scale,
+        .w = src.w * size * scale,
+        .h = src.h * size * scale
+    };
+
+    if ( src.w > 0 && src.h > 0 ) {
+        DrawTexture(texture, &src, &dst);
     }
 }
 
-void MakeBigDumbBackground(void)
+// A small checkerboard pattern that's tiled over the window. The pattern
+// has an even size, so copies of it line up seamlessly.
+void MakeBackground(void)
 {
-    const int bg_size = 2000; // probably big enough
-    background = CreateTexture(bg_size, bg_size);
-    SDL_SetRenderTarget(renderer, background);
-    for ( int y = 0; y < bg_size; y++ ) {
-        for ( int x = 0; x < bg_size; x++ ) {
-            if ( (x + y) % 2 == 0 ) {
-                SetGray(64);
-            } else {
-                SetRGBA(255, 100, 100, 255);
-            }
-            DrawPoint(x, y);
+    static u32 pattern[BG_TILE_SIZE * BG_TILE_SIZE];
+    u32 gray = PackColor((SDL_Color){ 64, 64, 64, 255 });
+    u32 red = PackColor((SDL_Color){ 255, 100, 100, 255 });
+
+    for ( int y = 0; y < BG_TILE_SIZE; y++ ) {
+        for ( int x = 0; x < BG_TILE_SIZE; x++ ) {
+            pattern[y * BG_TILE_SIZE + x] = (x + y) % 2 == 0 ? gray : red;
+        }
+    }
+
+    // streaming, so the software backend can blit it directly
+    background = AcquireTexture
+    (   SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        BG_TILE_SIZE,
+        BG_TILE_SIZE );
+
+    SDL_UpdateTexture
+    (   background,
+        NULL,
+        pattern,
+        BG_TILE_SIZE * sizeof(*pattern) );
+}
+
+// Fill the window with the background pattern, each texel drawn 2x2.
+void DrawBackground(SDL_Rect window_size)
+{
+    const int size = BG_TILE_SIZE * 2;
+
+    for ( int y = 0; y < window_size.h; y += size ) {
+        for ( int x = 0; x < window_size.w; x += size ) {
+            SDL_Rect dst = { x, y, size, size };
+            DrawTexture(background, NULL, &dst);
         }
     }
-    SDL_SetRenderTarget(renderer, NULL);
+}
+
+// Whether the next frame will look different even without any input.
+bool Busy(void)
+{
+    return (!infinite && tiles_remaining > 0)
+        || generation_state == generating
+        || ChunksPending();
+}
+
+void SaveTrace(void)
+{
+    if ( SaveChromeTrace(TRACE_PATH) ) {
+        printf("saved profile to %s\n", TRACE_PATH);
+    } else {
+        printf("could not write %s\n", TRACE_PATH);
+    }
+}
+
+// P: start profiling, or save what's been recorded so far.
+void ProfileKey(void)
+{
+    if ( profiler_enabled ) {
+        SaveTrace();
+    } else {
+        SetProfiling(true);
+        puts("profiling (press P again to save a trace)");
+    }
+}
+
+void UpdateFrameCounter(void)
+{
+    int now = SDL_GetTicks();
+    int elapsed = now - last_frame_ms;
+
+    frames++;
+    idle_percent = elapsed > 0 ? 100 * idle_ms / elapsed : 0;
+    idle_ms = 0;
+    last_frame_ms = now;
+}
+
+void EndStartupPhase(const char * name)
+{
+    u64 now = Now();
+
+    if ( num_startup_phases < MAX_STARTUP_PHASES ) {
+        startup_phases[num_startup_phases].name = name;
+        startup_phases[num_startup_phases].ms = NsToMs(now - startup_phase_start);
+        num_startup_phases++;
+    }
+
+    startup_phase_start = now;
+}
+
+void PrintStartupTimings(void)
+{
+    float total = 0.0f;
+
+    puts("startup timings:");
+    for ( int i = 0; i < num_startup_phases; i++ ) {
+        printf("  %-18s %7.2f ms\n", startup_phases[i].name, startup_phases[i].ms);
+        total += startup_phases[i].ms;
+    }
+    printf("  %-18s %7.2f ms\n", "total", total);
 }
 
 void SetUpWindowEtCetera(void)
 {
     SDL_Init(SDL_INIT_VIDEO);
+    EndStartupPhase("SDL init");
 
     SDL_DisplayMode mode;
     SDL_GetCurrentDisplayMode(0, &mode);
@@ -287,10 +1391,16 @@ void SetUpWindowEtCetera(void)
         .title = "WorldTweak",
         .width = mode.w * 0.625,
         .height = mode.h * 0.625,
-        .flags = SDL_WINDOW_RESIZABLE
+        .flags = SDL_WINDOW_RESIZABLE,
+        .backend = software ? BACKEND_SOFTWARE : BACKEND_SDL,
+        .render.flags = vsync ? SDL_RENDERER_PRESENTVSYNC : 0,
     };
     InitWindow(info);
-    MakeBigDumbBackground();
+    SetBatchMode(BATCH_ORDERED);
+    EndStartupPhase("window");
+
+    MakeBackground();
+    EndStartupPhase("background");
 
     //
     // set up text
@@ -298,31 +1408,73 @@ void SetUpWindowEtCetera(void)
     SetTextRenderer(renderer);
     SetFont(FONT_CP437_8X16);
     SetTextScale(2.0f, 2.0f);
+    EndStartupPhase("text");
 }
 
-int main()
+int main(int argc, char ** argv)
 {
+    // Now() works before InitTiming() and keeps the same time base, so
+    // calibrating counts as part of startup.
+    startup_phase_start = Now();
+    InitTiming(true);
+    SetProfilerThreadName("main");
+
     puts("worldtweak");
     puts("Perlin noise world generation tweaking tool");
     puts("by Thomas Foster\n");
 
     // viewCenter is the world coordinate that should
     // appear centered on screen.
-    int viewCenterX = world_width / 2;
-    int viewCenterY = world_height / 2;
-    float scale = 2.0f;
+    viewCenterX = world_width / 2;
+    viewCenterY = world_height / 2;
 
     // init default property values
     for ( int i = 0; i < NUM_PROPERTIES; i++ ) {
         properties[i].default_value = *properties[i].value;
     }
+    SaveHistory();
+
+    for ( int i = 1; i < argc; i++ ) {
+        if ( strcmp(argv[i], "--vsync") == 0 ) {
+            vsync = true;
+        } else if ( strcmp(argv[i], "--startup-timings") == 0 ) {
+            startup_timings = true;
+        } else if ( strcmp(argv[i], "--software") == 0 ) {
+            software = true;
+        } else if ( strcmp(argv[i], "--track-memory") == 0 ) {
+            EnableMemoryTracking(); // before anything is allocated
+        } else if ( strcmp(argv[i], "--profile") == 0 ) {
+            SetProfiling(true);
+        } else if ( strcmp(argv[i], "--hud") == 0 ) {
+            show_hud = true;
+        } else if ( strcmp(argv[i], "--stage-timings") == 0 ) {
+            stage_timings = true;
+        } else if ( strcmp(argv[i], "--bench") == 0 ) {
+            RunBenchmarks();
+            return 0;
+        } else {
+            printf("unknown option '%s'\n", argv[i]);
+            puts("usage: worldtweak [--vsync] [--startup-timings] [--software]"
+                 " [--track-memory] [--profile] [--hud] [--stage-timings]"
+                 " [--bench]");
+            return 1;
+        }
+    }
 
     SetUpWindowEtCetera();
+    InitDiskCache(DEFAULT_DISK_CACHE_BUDGET);
+    StartDiskWriter();
+    InitChunks(GenerateChunkClasses, DEFAULT_CHUNK_BUDGET);
+    InitTaskPool(MAX(DefaultWorkerCount() - 1, 1)); // + the main thread
+    InitGenerationGraph();
+    SetColors();
+    EndStartupPhase("caches and workers");
     int char_w = CharWidth();
     int char_h = CharHeight();
 
     puts("generating world");
     GenerateWorld();
+    EndStartupPhase("first generation");
 
     //
     // program loop
@@ -331,21 +1483,109 @@ int main()
 
         //
         // key input
+        // When nothing is changing, sleep until something happens.
         //
         SDL_Event ev;
-        while ( SDL_PollEvent( &ev ) ) {
+        int have_event;
+        if ( redraw || Busy() ) {
+            have_event = SDL_PollEvent(&ev);
+        } else {
+            int wait_start = SDL_GetTicks();
+            have_event = SDL_WaitEventTimeout(&ev, IDLE_TIMEOUT_MS);
+            idle_ms += SDL_GetTicks() - wait_start;
+            idle_wakeups++;
+        }
+
+        // Event handling counts as part of the frame: keys can regenerate
+        // the world. If nothing ends up drawn, the next frame starts over.
+        BeginHudFrame();
+
+        ZONE_BEGIN(events_zone, "events");
+        for ( ; have_event; have_event = SDL_PollEvent(&ev) ) {
+            if ( ev.type == SDL_KEYDOWN
+                || ev.type == SDL_KEYUP
+                || ev.type == SDL_WINDOWEVENT
+                || ev.type == chunk_ready_event )
+            {
+                redraw = true;
+            }
+
+            if ( ev.type == SDL_RENDER_TARGETS_RESET
+                || ev.type == SDL_RENDER_DEVICE_RESET )
+            {
+                // cached text was in render targets, which are now blank
+                ClearUICache();
+                property_panel.key = 0;
+                redraw = true;
+            }
+
             if ( ev.type == SDL_QUIT ) {
-                SDL_DestroyTexture(world);
+                if ( profiler_enabled ) {
+                    SaveTrace();
+                }
+
+                if ( MemoryTracking() ) {
+                    PrintMemoryReport(stdout);
+                }
+
+                ShutdownChunks();
+                StopDiskWriter();
+                FreeTaskGraph(&generation_graph);
+                ShutdownTaskPool();
+                ReleaseTexture(world);
+                ReleaseTexture(background);
+                ClearCache();
+                ClearMipPyramid();
+                ClearUICache();
+                FreePanel(&property_panel);
+                ClearTexturePool();
+                FreeArena(&frame_arena);
+                if ( !buffers_published ) {
+                    MemFree(field);
+                    MemFree(classes);
+                }
+                ShutdownSnapshots(); // frees them otherwise
+                MemFree(tile_done);
+                MemFree(tile_order);
+                MemFree(tile_dirty);
+                MemFree(tile_pixels);
                 SDL_Quit();
                 return 0;
             } else if ( ev.type == SDL_KEYDOWN ) {
                 switch ( ev.key.keysym.sym ) {
                     case SDLK_EQUALS:   scale *= 2.0f; break;
-                    case SDLK_MINUS:    scale = MAX(scale / 2, 1.0f); break;
+                    case SDLK_MINUS:
+                        scale = MAX(scale / 2, infinite ? 1.0f : MIN_SCALE);
+                        break;
                     case SDLK_DOWN:     ListDirectionKey(DIR_DOWN); break;
                     case SDLK_UP:       ListDirectionKey(DIR_UP); break;
                     case SDLK_RIGHT:    ListDirectionKey(DIR_RIGHT); break;
                     case SDLK_LEFT:     ListDirectionKey(DIR_LEFT); break;
+                    case SDLK_m:        PrintMemoryReport(stdout); break;
+                    case SDLK_p:        ProfileKey(); break;
+                    case SDLK_z:        StepHistory(-1); break;
+                    case SDLK_y:        StepHistory(+1); break;
+                    case SDLK_v:
+                        viewport_first = !viewport_first;
+                        break;
+                    case SDLK_f:
+                        detail = !detail;
+                        break;
+                    case SDLK_h:
+                        show_hud = !show_hud;
+                        break;
+                    case SDLK_c:
+                        grayscale = !grayscale;
+                        SetColors();
+                        break;
+                    case SDLK_i:
+                        ResetChunks(); // chunks are made differently now
+                        infinite = !infinite;
+                        scale = infinite ? MAX(scale, 1.0f) : scale;
+                        if ( !infinite && world_stale ) {
+                            GenerateWorld();
+                        }
+                        break;
                     case SDLK_RETURN:
                         if ( generation_state == dirty ) {
                             generation_state = generating;
@@ -356,6 +1596,7 @@ int main()
                 }
             }
         }
+        ZONE_END(events_zone);
 
         //
         // scroll map
@@ -375,29 +1616,65 @@ int main()
 
             if ( keyboard[SDL_SCANCODE_D] )
                 viewCenterX += step;
+
+            if ( keyboard[SDL_SCANCODE_W] || keyboard[SDL_SCANCODE_S]
+                || keyboard[SDL_SCANCODE_A] || keyboard[SDL_SCANCODE_D] )
+            {
+                redraw = true;
+            }
+        }
+
+        if ( !redraw && !Busy() ) {
+            continue;
         }
 
+        redraw = false; // anything below may set it again for the next frame
+        ResetArena(&frame_arena);
+        ReclaimSnapshots(); // e.g. worlds the disk cache is done writing
+
         //
         // clear and draw background
         //
+        SDL_Rect window_size = GetWindowSize();
+
         SetGray(0);
         Clear();
-        SDL_Rect win_size = GetWindowSize();
-        SDL_Rect bg_src = { 0, 0, win_size.w / 2, win_size.h / 2 };
-        DrawTexture(background, &bg_src, NULL);
-
-        SDL_Rect window_size = GetWindowSize();
+        DrawBackground(window_size);
 
         //
         // draw map view
         //
-        SDL_Rect dst = {
-            .x = (window_size.w / 2) - viewCenterX * scale,
-            .y = (window_size.h / 2) - viewCenterY * scale,
-            .w = world_width * scale,
-            .h = world_height * scale
-        };
-        DrawTexture(world, NULL, &dst);
+        BeginChunkFrame();
+
+        if ( infinite ) {
+            DrawChunks
+            (   viewCenterX,
+                viewCenterY,
+                scale,
+                window_size.w,
+                window_size.h,
+                0,
+                NULL );
+        } else {
+            DrawWorld();
+
+            // the last tiles are only uploaded by the next DrawWorld()
+            int remaining = tiles_remaining;
+            ContinueGeneration(FILL_BUDGET_MS);
+            redraw |= tiles_remaining != remaining;
+        }
+
+        if ( detail && scale >= DETAIL_SCALE ) {
+            SDL_Rect bounds = { 0, 0, world_width, world_height };
+            DrawChunks
+            (   viewCenterX,
+                viewCenterY,
+                scale,
+                window_size.w,
+                window_size.h,
+                MIN(log2f(scale), MAX_CHUNK_LOD),
+                infinite ? NULL : &bounds );
+        }
 
         //
         // draw list
@@ -420,6 +1697,7 @@ int main()
                 Present();
                 GenerateWorld();
                 generation_state = clean;
+                redraw = true;
                 break;
             default:
                 break;
@@ -430,9 +1708,73 @@ int main()
         //
         SetRGBA(255, 255, 100, 255);
         PrintLabel(16, 16, "Adjust Map: WASD, -/+");
-        PrintLabel(16, window_size.h - 48, "Generation Time: %d ms", generation_ms);
+        PrintLabel(16, 64, "Undo/Redo: Z/Y (%d/%d)", history_index + 1, history_count);
+        PrintLabel
+        (   16,
+            112,
+            "Viewport First [V]: %s",
+            viewport_first ? "On" : "Off" );
+        PrintLabel(16, 160, "Infinite World [I]: %s", infinite ? "On" : "Off");
+        PrintLabel(16, 208, "Zoom Detail [F]: %s", detail ? "On" : "Off");
+        PrintLabel(16, 256, "Grayscale [C]: %s", grayscale ? "On" : "Off");
+        PrintLabel(16, 304, "Perf HUD [H]: %s", show_hud ? "On" : "Off");
+
+        if ( infinite ) {
+            chunk_stats_t chunks = ChunkStats();
+            PrintDynamicLabel
+            (   16,
+                window_size.h - 48,
+                "Chunks: %d (%d queued)",
+                chunks.count,
+                chunks.queued );
+        } else if ( tiles_remaining > 0 ) {
+            int num_tiles = tiles_x * tiles_y;
+            PrintDynamicLabel
+            (   16,
+                window_size.h - 48,
+                "Generating: %d%%",
+                100 * (num_tiles - tiles_remaining) / num_tiles );
+        } else {
+            PrintLabel
+            (   16,
+                window_size.h - 48,
+                "Generation Time: %.2f ms%s, Last Upload: %d KB",
+                NsToMs(generation_ns),
+                generation_cached ? " (cached)" : "",
+                last_upload_bytes / 1024 );
+        }
+
+        PrintDynamicLabel
+        (   16,
+            window_size.h - 96,
+            "Frames: %u, Idle: %d%% (%u wakeups), Scratch: %zu KB peak",
+            frames,
+            idle_percent,
+            idle_wakeups,
+            frame_arena.high_water / 1024 );
+
+        // left of the property list
+        if ( show_hud ) {
+            DrawHud
+            (   window_size.w - 350 - LABEL_MARGIN - 16 - HudWidth(),
+                16 - LABEL_MARGIN,
+                &generation_graph );
+        }
 
         Present();
-        SDL_Delay(10);
+        EndHudFrame();
+        UpdateFrameCounter();
+
+        if ( frames == 1 ) {
+            EndStartupPhase("first frame");
+            if ( startup_timings ) {
+                PrintStartupTimings();
+            }
+        }
+
+        // with vsync, Present() already waited for the display
+        if ( !vsync ) {
+            SDL_Delay(FRAME_DELAY_MS);
+        }
     }
 }
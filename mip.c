@@ -0,0 +1,156 @@
+#include "mip.h"
+#include "mylib/mathlib.h"
+#include "mylib/video.h"
+
+static mip_level_t levels[MAX_MIP_LEVELS + 1]; // [0] is unused
+
+int MipLevelForScale(float scale)
+{
+    int level = 0;
+
+    while ( level < MAX_MIP_LEVELS && scale * (2 << level) <= 1.0f ) {
+        level++;
+    }
+
+    return level;
+}
+
+void MipLevelSize(int level, int world_w, int world_h, int * w, int * h)
+{
+    int size = 1 << level;
+    *w = (world_w + size - 1) / size;
+    *h = (world_h + size - 1) / size;
+}
+
+const mip_level_t * MipLevel(int level)
+{
+    return &levels[level];
+}
+
+// The most common class in a 2x2 block of the source level. Ties go to
+// whichever came first (top-left) so results don't depend on class order.
+static u8 Mode(const u8 * src, int src_w, int src_h, int x, int y)
+{
+    u8 block[4];
+    int n = 0;
+
+    for ( int dy = 0; dy < 2 && y + dy < src_h; dy++ ) {
+        for ( int dx = 0; dx < 2 && x + dx < src_w; dx++ ) {
+            block[n++] = src[(y + dy) * src_w + x + dx];
+        }
+    }
+
+    u8 best = block[0];
+    int best_count = 0;
+
+    for ( int i = 0; i < n; i++ ) {
+        int count = 0;
+        for ( int j = i; j < n; j++ ) {
+            count += block[j] == block[i];
+        }
+
+        if ( count > best_count ) {
+            best = block[i];
+            best_count = count;
+        }
+    }
+
+    return best;
+}
+
+static void Upload(mip_level_t * level, const u32 colors[16])
+{
+    if ( level->texture ) {
+        int w, h;
+        SDL_QueryTexture(level->texture, NULL, NULL, &w, &h);
+        if ( w != level->width || h != level->height ) {
+            ReleaseTexture(level->texture);
+            level->texture = NULL;
+        }
+    }
+
+    if ( level->texture == NULL ) {
+        level->texture = AcquireTexture
+        (   SDL_PIXELFORMAT_RGBA8888,
+            SDL_TEXTUREACCESS_STREAMING,
+            level->width,
+            level->height );
+    }
+
+    UpdateTextureIndexed
+    (   level->texture,
+        NULL,
+        level->classes,
+        level->width,
+        colors );
+}
+
+static void Resize(mip_level_t * level, int w, int h)
+{
+    level->width = w;
+    level->height = h;
+    level->classes = MemRealloc(MEM_GENERATION, level->classes, w * h);
+
+    if ( level->classes == NULL ) {
+        Error("out of memory");
+    }
+}
+
+void BuildMipPyramid(const u8 * classes, int w, int h, const u32 colors[16])
+{
+    const u8 * src = classes;
+    int src_w = w;
+    int src_h = h;
+
+    for ( int i = 1; i <= MAX_MIP_LEVELS; i++ ) {
+        mip_level_t * level = &levels[i];
+        int level_w, level_h;
+        MipLevelSize(i, w, h, &level_w, &level_h);
+        Resize(level, level_w, level_h);
+
+        for ( int y = 0; y < level_h; y++ ) {
+            for ( int x = 0; x < level_w; x++ ) {
+                level->classes[y * level_w + x]
+                    = Mode(src, src_w, src_h, x * 2, y * 2);
+            }
+        }
+
+        Upload(level, colors);
+
+        src = level->classes;
+        src_w = level_w;
+        src_h = level_h;
+    }
+}
+
+void SetMipLevel
+(   int level,
+    const u8 * classes,
+    int world_w,
+    int world_h,
+    const u32 colors[16] )
+{
+    int w, h;
+    MipLevelSize(level, world_w, world_h, &w, &h);
+    Resize(&levels[level], w, h);
+    memcpy(levels[level].classes, classes, w * h);
+    Upload(&levels[level], colors);
+}
+
+void RecolorMipPyramid(const u32 colors[16])
+{
+    for ( int i = 1; i <= MAX_MIP_LEVELS; i++ ) {
+        if ( levels[i].texture ) {
+            Upload(&levels[i], colors);
+        }
+    }
+}
+
+void ClearMipPyramid(void)
+{
+    for ( int i = 1; i <= MAX_MIP_LEVELS; i++ ) {
+        ReleaseTexture(levels[i].texture);
+        MemFree(levels[i].classes);
+        levels[i] = (mip_level_t){ 0 };
+    }
+}
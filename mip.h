@@ -0,0 +1,53 @@
+// -----------------------------------------------------------------------------
+//  Mip Pyramid
+//
+//  Half-size copies of the classified world map for drawing zoomed-out
+//  views. Each level is built from the one above it with a 2x2 mode
+//  (majority) filter, so borders between layers stay crisp instead of
+//  blurring into colors that don't exist. A level can also be generated
+//  directly at its own resolution before the full-size map is done.
+// -----------------------------------------------------------------------------
+#ifndef __MIP_H__
+#define __MIP_H__
+
+#include "mylib/genlib.h"
+
+#define MAX_MIP_LEVELS 6 // level n is 1/2^n the size of the world
+
+typedef struct {
+    int width;
+    int height;
+    u8 * classes;           // layer index per texel
+    SDL_Texture * texture;  // RGBA8888, NULL if the level isn't built
+} mip_level_t;
+
+/// The level whose texels are closest to, but not smaller than, one screen
+/// pixel at the given draw scale. Level 0 is the world itself.
+int MipLevelForScale(float scale);
+
+/// Size of level `level` of a world of the given size.
+void MipLevelSize(int level, int world_w, int world_h, int * w, int * h);
+
+/// Get a level (1...MAX_MIP_LEVELS).
+const mip_level_t * MipLevel(int level);
+
+/// Build every level from a full-size class map.
+/// - Parameter colors: palette the classes are expanded with on upload.
+void BuildMipPyramid(const u8 * classes, int w, int h, const u32 colors[16]);
+
+/// Set a single level from classes generated directly at its resolution.
+/// `classes` must be the size returned by `MipLevelSize()`.
+void SetMipLevel
+(   int level,
+    const u8 * classes,
+    int world_w,
+    int world_h,
+    const u32 colors[16] );
+
+/// Re-upload every built level with new colors.
+void RecolorMipPyramid(const u32 colors[16]);
+
+/// Throw away all levels, e.g. when a new world is started.
+void ClearMipPyramid(void);
+
+#endif /* __MIP_H__ */
@@ -0,0 +1,354 @@
+#include "framebuffer.h"
+#include "mathlib.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static framebuffer_t fb;
+static bool active;
+static SDL_Window * window;
+static SDL_Surface * surface; // wraps fb.pixels for the software renderer
+static SDL_Renderer * software_renderer;
+static SDL_Renderer * window_renderer; // unowned
+static SDL_Texture * frame; // streaming, on window_renderer
+
+// source column for each destination column of a scaled blit
+static int * column_map;
+static int column_map_size;
+
+#pragma mark -
+
+static void UpdateClip(void)
+{
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+
+    fb.clip = (SDL_Rect){ 0, 0, MIN(w, fb.width), MIN(h, fb.height) };
+}
+
+static bool ClipRect(SDL_Rect * rect)
+{
+    return SDL_IntersectRect(rect, &fb.clip, rect);
+}
+
+static u32 Blend(u32 src, u32 dst)
+{
+    u32 a = src & 0xFF;
+
+    if ( a == 0xFF ) {
+        return src;
+    } else if ( a == 0 ) {
+        return dst;
+    }
+
+    u32 inv = 0xFF - a;
+    u32 r = ((src >> 24) * a + (dst >> 24) * inv + 127) / 255;
+    u32 g = ((src >> 16 & 0xFF) * a + (dst >> 16 & 0xFF) * inv + 127) / 255;
+    u32 b = ((src >> 8 & 0xFF) * a + (dst >> 8 & 0xFF) * inv + 127) / 255;
+    u32 out_a = a + ((dst & 0xFF) * inv + 127) / 255;
+
+    return r << 24 | g << 16 | b << 8 | out_a;
+}
+
+// Set `count` pixels to `color`.
+static void FillSpan(u32 * pixels, int count, u32 color)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    __m128i c = _mm_set1_epi32(color);
+    for ( ; i + 16 <= count; i += 16 ) {
+        _mm_storeu_si128((__m128i *)(pixels + i + 0), c);
+        _mm_storeu_si128((__m128i *)(pixels + i + 4), c);
+        _mm_storeu_si128((__m128i *)(pixels + i + 8), c);
+        _mm_storeu_si128((__m128i *)(pixels + i + 12), c);
+    }
+    for ( ; i + 4 <= count; i += 4 ) {
+        _mm_storeu_si128((__m128i *)(pixels + i), c);
+    }
+#elif defined(__ARM_NEON)
+    uint32x4_t c = vdupq_n_u32(color);
+    for ( ; i + 4 <= count; i += 4 ) {
+        vst1q_u32(pixels + i, c);
+    }
+#endif
+
+    for ( ; i < count; i++ ) {
+        pixels[i] = color;
+    }
+}
+
+// Blend `count` pixels of `src` onto `dst`, skipping work for fully
+// transparent and fully opaque runs, which is most of them.
+static void BlendSpan(u32 * dst, const u32 * src, int count)
+{
+    for ( int i = 0; i < count; i++ ) {
+        u32 a = src[i] & 0xFF;
+
+        if ( a == 0xFF ) {
+            dst[i] = src[i];
+        } else if ( a != 0 ) {
+            dst[i] = Blend(src[i], dst[i]);
+        }
+    }
+}
+
+#pragma mark - PUBLIC FUNCTIONS
+
+SDL_Renderer * InitFramebuffer(SDL_Window * _window, SDL_Renderer * _window_renderer)
+{
+    window = _window;
+    window_renderer = _window_renderer;
+
+    // Big enough for the window to be maximized without reallocating,
+    // which would invalidate every texture made with the software renderer.
+    SDL_DisplayMode mode;
+    if ( SDL_GetDesktopDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) != 0 ) {
+        Error("could not get display mode (%s)", SDL_GetError());
+    }
+
+    int w, h;
+    SDL_GetWindowSize(window, &w, &h);
+    fb.width = MAX(mode.w, w);
+    fb.height = MAX(mode.h, h);
+    fb.pitch = fb.width;
+    fb.pixels = MemCalloc(MEM_VIDEO, fb.width * fb.height, sizeof(*fb.pixels));
+
+    if ( fb.pixels == NULL ) {
+        Error("could not allocate framebuffer");
+    }
+
+    surface = SDL_CreateRGBSurfaceWithFormatFrom
+    (   fb.pixels,
+        fb.width,
+        fb.height,
+        32,
+        fb.pitch * sizeof(*fb.pixels),
+        SDL_PIXELFORMAT_RGBA8888 );
+
+    if ( surface == NULL ) {
+        Error("could not create framebuffer surface (%s)", SDL_GetError());
+    }
+
+    software_renderer = SDL_CreateSoftwareRenderer(surface);
+    if ( software_renderer == NULL ) {
+        Error("could not create software renderer (%s)", SDL_GetError());
+    }
+
+    frame = SDL_CreateTexture
+    (   window_renderer,
+        SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STREAMING,
+        fb.width,
+        fb.height );
+
+    if ( frame == NULL ) {
+        Error("could not create framebuffer texture (%s)", SDL_GetError());
+    }
+
+    MemNoteTexture(frame, true);
+    UpdateClip();
+    active = true;
+
+    return software_renderer;
+}
+
+void ShutdownFramebuffer(void)
+{
+    if ( !active ) {
+        return;
+    }
+
+    MemNoteTexture(frame, false);
+    SDL_DestroyTexture(frame);
+    SDL_DestroyRenderer(software_renderer);
+    SDL_FreeSurface(surface);
+    MemFree(fb.pixels);
+    MemFree(column_map);
+
+    fb = (framebuffer_t){ 0 };
+    column_map = NULL;
+    column_map_size = 0;
+    active = false;
+}
+
+const framebuffer_t * Framebuffer(void)
+{
+    return active ? &fb : NULL;
+}
+
+void SyncFramebuffer(void)
+{
+    SDL_RenderFlush(software_renderer);
+}
+
+static void Fill(SDL_Rect rect, u32 color, bool blend)
+{
+    if ( !ClipRect(&rect) || (blend && (color & 0xFF) == 0) ) {
+        return;
+    }
+
+    for ( int y = rect.y; y < rect.y + rect.h; y++ ) {
+        u32 * row = &fb.pixels[y * fb.pitch + rect.x];
+
+        if ( !blend || (color & 0xFF) == 0xFF ) {
+            FillSpan(row, rect.w, color);
+        } else {
+            for ( int x = 0; x < rect.w; x++ ) {
+                row[x] = Blend(color, row[x]);
+            }
+        }
+    }
+}
+
+void FramebufferFill(SDL_Rect rect, u32 color, bool blend)
+{
+    SyncFramebuffer();
+    Fill(rect, color, blend);
+}
+
+void FramebufferPoints(const SDL_Point * points, int count, u32 color, bool blend)
+{
+    SyncFramebuffer();
+
+    for ( int i = 0; i < count; i++ ) {
+        if ( SDL_PointInRect(&points[i], &fb.clip) ) {
+            u32 * pixel = &fb.pixels[points[i].y * fb.pitch + points[i].x];
+            *pixel = blend ? Blend(color, *pixel) : color;
+        }
+    }
+}
+
+void FramebufferBlit
+(   const u32 * pixels,
+    int pitch,
+    int w,
+    int h,
+    const SDL_Rect * _src,
+    const SDL_Rect * _dst,
+    bool blend )
+{
+    SDL_Rect src = _src ? *_src : (SDL_Rect){ 0, 0, w, h };
+    SDL_Rect dst = _dst ? *_dst : fb.clip;
+    SDL_Rect clipped = dst;
+
+    if ( src.w <= 0 || src.h <= 0 || !ClipRect(&clipped) ) {
+        return;
+    }
+
+    SyncFramebuffer();
+
+    if ( src.w == dst.w && src.h == dst.h ) {
+        int sx = src.x + clipped.x - dst.x;
+        int sy = src.y + clipped.y - dst.y;
+
+        for ( int y = 0; y < clipped.h; y++ ) {
+            u32 * out = &fb.pixels[(clipped.y + y) * fb.pitch + clipped.x];
+            const u32 * in = &pixels[(sy + y) * pitch + sx];
+
+            if ( blend ) {
+                BlendSpan(out, in, clipped.w);
+            } else {
+                memcpy(out, in, clipped.w * sizeof(*out));
+            }
+        }
+
+        return;
+    }
+
+    // Scaled: map each destination column to a source column once, then
+    // gather rows through the map.
+    if ( clipped.w > column_map_size ) {
+        column_map_size = clipped.w;
+        column_map = MemRealloc
+        (   MEM_VIDEO,
+            column_map,
+            column_map_size * sizeof(*column_map) );
+
+        if ( column_map == NULL ) {
+            Error("out of memory");
+        }
+    }
+
+    for ( int x = 0; x < clipped.w; x++ ) {
+        s64 dx = clipped.x + x - dst.x;
+        column_map[x] = src.x + dx * src.w / dst.w;
+    }
+
+    for ( int y = 0; y < clipped.h; y++ ) {
+        s64 dy = clipped.y + y - dst.y;
+        const u32 * in = &pixels[(src.y + dy * src.h / dst.h) * pitch];
+        u32 * out = &fb.pixels[(clipped.y + y) * fb.pitch + clipped.x];
+
+        if ( blend ) {
+            for ( int x = 0; x < clipped.w; x++ ) {
+                u32 texel = in[column_map[x]];
+                u32 a = texel & 0xFF;
+
+                if ( a == 0xFF ) {
+                    out[x] = texel;
+                } else if ( a != 0 ) {
+                    out[x] = Blend(texel, out[x]);
+                }
+            }
+        } else {
+            for ( int x = 0; x < clipped.w; x++ ) {
+                out[x] = in[column_map[x]];
+            }
+        }
+    }
+}
+
+void FramebufferGlyph
+(   int x,
+    int y,
+    const u8 * bits,
+    int w,
+    int h,
+    float scale_x,
+    float scale_y,
+    u32 color )
+{
+    bool blend = (color & 0xFF) != 0xFF;
+    int bit = 0;
+
+    SyncFramebuffer();
+
+    for ( int row = 0; row < h; row++ ) {
+        int y0 = y + (int)(row * scale_y);
+        int y1 = y + (int)((row + 1) * scale_y);
+
+        // fill each run of lit pixels in the row as one span
+        int run_start = -1;
+        for ( int col = 0; col <= w; col++, bit++ ) {
+            bool lit = col < w && bits[bit / 8] & (0x80 >> bit % 8);
+
+            if ( lit && run_start < 0 ) {
+                run_start = col;
+            } else if ( !lit && run_start >= 0 ) {
+                int x0 = x + (int)(run_start * scale_x);
+                int x1 = x + (int)(col * scale_x);
+                Fill((SDL_Rect){ x0, y0, x1 - x0, y1 - y0 }, color, blend);
+                run_start = -1;
+            }
+        }
+        bit--; // the extra column wasn't a bit
+    }
+}
+
+void PresentFramebuffer(void)
+{
+    SyncFramebuffer();
+
+    SDL_Rect clip = fb.clip;
+    if ( clip.w > 0 && clip.h > 0 ) {
+        SDL_UpdateTexture(frame, &clip, fb.pixels, fb.pitch * sizeof(*fb.pixels));
+        SDL_RenderCopy(window_renderer, frame, &clip, &clip);
+    }
+
+    SDL_RenderPresent(window_renderer);
+    UpdateClip(); // the window may have been resized
+}
@@ -0,0 +1,76 @@
+// -----------------------------------------------------------------------------
+// Software Framebuffer
+//
+// A CPU-side frame for machines where each renderer call is expensive
+// (SDL's software renderer, remote desktops). Everything is drawn into
+// memory and the finished frame is uploaded to the window with a single
+// streaming texture update.
+//
+// A software renderer is created on top of the same memory, so textures,
+// render targets, and SDL drawing calls keep working. The functions below
+// write pixels directly and are much cheaper for the common cases.
+// -----------------------------------------------------------------------------
+#ifndef __FRAMEBUFFER_H__
+#define __FRAMEBUFFER_H__
+
+#include "genlib.h"
+#include <SDL.h>
+
+typedef struct {
+    u32 * pixels;   // RGBA8888
+    int width;      // allocated size, the size of the display
+    int height;
+    int pitch;      // in pixels
+    SDL_Rect clip;  // the part that's on screen, i.e. the window size
+} framebuffer_t;
+
+/// Create a framebuffer for `window`, presented with `window_renderer`.
+/// - Returns: A software renderer that draws into the framebuffer.
+SDL_Renderer * InitFramebuffer(SDL_Window * window, SDL_Renderer * window_renderer);
+
+void ShutdownFramebuffer(void);
+
+/// Get the framebuffer, or `NULL` if there isn't one.
+const framebuffer_t * Framebuffer(void);
+
+/// Wait for drawing done through the software renderer, so that pixels can
+/// be written directly without getting out of order. Called by the
+/// functions below.
+void SyncFramebuffer(void);
+
+/// Fill a rect, clipped to the framebuffer.
+/// - Parameter blend: Alpha blend `color` instead of replacing pixels.
+void FramebufferFill(SDL_Rect rect, u32 color, bool blend);
+
+void FramebufferPoints(const SDL_Point * points, int count, u32 color, bool blend);
+
+/// Copy part of an image, scaled with nearest-neighbor sampling if the
+/// source and destination sizes differ.
+/// - Parameter pitch: Pixels between rows of `pixels`.
+/// - Parameter src: The part of the image to draw, or `NULL` for all of it.
+/// - Parameter dst: Where to draw it, or `NULL` for the whole framebuffer.
+void FramebufferBlit
+(   const u32 * pixels,
+    int pitch,
+    int w,
+    int h,
+    const SDL_Rect * src,
+    const SDL_Rect * dst,
+    bool blend );
+
+/// Draw a 1-bit glyph (w * h bits, most significant first, rows packed
+/// back to back), with each bit scaled to `scale_x` by `scale_y` pixels.
+void FramebufferGlyph
+(   int x,
+    int y,
+    const u8 * bits,
+    int w,
+    int h,
+    float scale_x,
+    float scale_y,
+    u32 color );
+
+/// Upload the frame to the window and show it.
+void PresentFramebuffer(void);
+
+#endif /* __FRAMEBUFFER_H__ */
@@ -1,5 +1,9 @@
 #include "genlib.h"
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 #define PRINT_DEF(func, T, format) \
     PRINT_DECL(func, T) { printf("%s: "format"\n", name, value); }
 
@@ -30,17 +34,694 @@ FILE * OpenFile(const char * file_name, const char * mode)
     return file;
 }
 
-// TODO: check portability
-float ProgramTime(void)
+u64 HashBytes(const void * data, size_t size, u64 hash)
+{
+    const u8 * bytes = data;
+
+    for ( size_t i = 0; i < size; i++ ) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+#pragma mark - MEMORY TRACKING
+
+typedef struct {
+    u64 tag;
+    u64 size;
+} mem_header_t; // 16 bytes, so allocations keep malloc's alignment
+
+static const char * mem_tag_names[NUM_MEM_TAGS] = {
+    [MEM_OTHER]         = "other",
+    [MEM_VIDEO]         = "video",
+    [MEM_TEXTURE]       = "texture (est.)",
+    [MEM_TEXT]          = "text",
+    [MEM_GENERATION]    = "generation",
+    [MEM_CACHE]         = "cache",
+    [MEM_SCRATCH]       = "scratch",
+};
+
+static mem_stats_t mem_stats[NUM_MEM_TAGS];
+static bool tracking;
+static bool tracking_started; // a Mem* allocation has been made
+
+// Worker threads allocate too, so counters are updated atomically.
+static void AtomicMax(s64 * peak, s64 value)
+{
+    s64 old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while ( value > old
+           && !__atomic_compare_exchange_n(peak, &old, value, true,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+        ;
+}
+
+void MemNote(mem_tag_t tag, s64 bytes, int count)
+{
+    if ( !tracking ) {
+        return;
+    }
+
+    mem_stats_t * stats = &mem_stats[tag];
+    s64 new_bytes = __atomic_add_fetch(&stats->bytes, bytes, __ATOMIC_RELAXED);
+    s64 new_count = __atomic_add_fetch(&stats->count, count, __ATOMIC_RELAXED);
+
+    if ( count > 0 ) {
+        __atomic_add_fetch(&stats->total, count, __ATOMIC_RELAXED);
+    }
+
+    AtomicMax(&stats->peak_bytes, new_bytes);
+    AtomicMax(&stats->peak_count, new_count);
+}
+
+void MemNoteTexture(SDL_Texture * texture, bool created)
+{
+    u32 format;
+    int w, h;
+
+    if ( !tracking || texture == NULL
+        || SDL_QueryTexture(texture, &format, NULL, &w, &h) != 0 )
+    {
+        return;
+    }
+
+    s64 bytes = (s64)w * h * SDL_BYTESPERPIXEL(format);
+    MemNote(MEM_TEXTURE, created ? bytes : -bytes, created ? 1 : -1);
+}
+
+void EnableMemoryTracking(void)
+{
+    if ( tracking_started && !tracking ) {
+        Error("memory tracking must be enabled before any Mem* allocation");
+    }
+
+    tracking = true;
+}
+
+bool MemoryTracking(void)
+{
+    return tracking;
+}
+
+void * MemAlloc(mem_tag_t tag, size_t size)
+{
+    __atomic_store_n(&tracking_started, true, __ATOMIC_RELAXED);
+
+    if ( !tracking ) {
+        return malloc(size);
+    }
+
+    mem_header_t * header = malloc(sizeof(*header) + size);
+    if ( header == NULL ) {
+        fprintf(stderr, "MemAlloc: failed to allocate %zu bytes for %s\n",
+                size, mem_tag_names[tag]);
+        PrintMemoryReport(stderr);
+        return NULL;
+    }
+
+    header->tag = tag;
+    header->size = size;
+    MemNote(tag, size, 1);
+
+    return header + 1;
+}
+
+void * MemCalloc(mem_tag_t tag, size_t count, size_t size)
+{
+    void * ptr = MemAlloc(tag, count * size);
+
+    if ( ptr ) {
+        memset(ptr, 0, count * size);
+    }
+
+    return ptr;
+}
+
+void * MemRealloc(mem_tag_t tag, void * ptr, size_t size)
+{
+    __atomic_store_n(&tracking_started, true, __ATOMIC_RELAXED);
+
+    if ( !tracking ) {
+        return realloc(ptr, size);
+    } else if ( ptr == NULL ) {
+        return MemAlloc(tag, size);
+    }
+
+    mem_header_t * header = (mem_header_t *)ptr - 1;
+    mem_tag_t old_tag = header->tag;
+    s64 old_size = header->size;
+
+    mem_header_t * new_header = realloc(header, sizeof(*header) + size);
+    if ( new_header == NULL ) {
+        fprintf(stderr, "MemRealloc: failed to allocate %zu bytes for %s\n",
+                size, mem_tag_names[tag]);
+        PrintMemoryReport(stderr);
+        return NULL;
+    }
+
+    MemNote(old_tag, -old_size, -1);
+    new_header->tag = tag;
+    new_header->size = size;
+    MemNote(tag, size, 1);
+
+    return new_header + 1;
+}
+
+void MemFree(void * ptr)
+{
+    if ( !tracking || ptr == NULL ) {
+        free(ptr);
+        return;
+    }
+
+    mem_header_t * header = (mem_header_t *)ptr - 1;
+    MemNote(header->tag, -(s64)header->size, -1);
+    free(header);
+}
+
+mem_stats_t MemStats(mem_tag_t tag)
+{
+    const mem_stats_t * s = &mem_stats[tag];
+
+    return (mem_stats_t){
+        .bytes = __atomic_load_n(&s->bytes, __ATOMIC_RELAXED),
+        .peak_bytes = __atomic_load_n(&s->peak_bytes, __ATOMIC_RELAXED),
+        .count = __atomic_load_n(&s->count, __ATOMIC_RELAXED),
+        .peak_count = __atomic_load_n(&s->peak_count, __ATOMIC_RELAXED),
+        .total = __atomic_load_n(&s->total, __ATOMIC_RELAXED),
+    };
+}
+
+void PrintMemoryReport(FILE * file)
+{
+    if ( !tracking ) {
+        fprintf(file, "memory tracking is off\n");
+        return;
+    }
+
+    mem_stats_t total = { 0 };
+
+    fprintf(file, "memory:            current KB    peak KB     count      peak     total\n");
+    for ( int i = 0; i < NUM_MEM_TAGS; i++ ) {
+        mem_stats_t stats = MemStats(i);
+        fprintf(file, "  %-16s %10lld %10lld %9lld %9lld %9lld\n",
+                mem_tag_names[i],
+                (long long)stats.bytes / 1024,
+                (long long)stats.peak_bytes / 1024,
+                (long long)stats.count,
+                (long long)stats.peak_count,
+                (long long)stats.total);
+
+        total.bytes += stats.bytes;
+        total.count += stats.count;
+        total.total += stats.total;
+    }
+
+    // (the sum of peaks isn't a peak, so it's left out)
+    fprintf(file, "  %-16s %10lld %10s %9lld %9s %9lld\n",
+            "all",
+            (long long)total.bytes / 1024,
+            "",
+            (long long)total.count,
+            "",
+            (long long)total.total);
+}
+
+#pragma mark - ARENA
+
+struct arena_block {
+    arena_block_t * next;
+    size_t size;    // usable bytes, after the header
+    size_t offset;  // bytes in use
+    size_t mapped;  // if mmap'd, the size of the mapping
+};
+
+#define ALIGN_UP(n, a) (((n) + (a) - 1) & ~((size_t)(a) - 1))
+#define HEADER_SIZE ALIGN_UP(sizeof(arena_block_t), ARENA_ALIGN)
+
+arena_t frame_arena = { .block_size = ARENA_BLOCK_SIZE };
+
+static u8 * BlockData(arena_block_t * block)
+{
+    return (u8 *)block + HEADER_SIZE;
+}
+
+static arena_block_t * NewBlock(size_t size, bool huge_pages)
+{
+    size_t total = ALIGN_UP(HEADER_SIZE + size, ARENA_ALIGN);
+    arena_block_t * block = NULL;
+    size_t mapped = 0;
+
+#ifdef __linux__
+    // Transparent huge pages cut TLB misses when walking big buffers.
+    if ( huge_pages && total >= ARENA_HUGE_PAGE_SIZE ) {
+        total = ALIGN_UP(total, ARENA_HUGE_PAGE_SIZE);
+        void * map = mmap
+        (   NULL,
+            total,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS,
+            -1,
+            0 );
+
+        if ( map != MAP_FAILED ) {
+            madvise(map, total, MADV_HUGEPAGE); // only a hint
+            block = map;
+            mapped = total;
+        }
+    }
+#else
+    (void)huge_pages;
+#endif
+
+    if ( block == NULL ) {
+        block = aligned_alloc(ARENA_ALIGN, total);
+        if ( block == NULL ) {
+            Error("out of memory (%zu bytes)", total);
+        }
+    }
+
+    MemNote(MEM_SCRATCH, total, 1);
+    block->next = NULL;
+    block->size = total - HEADER_SIZE;
+    block->offset = 0;
+    block->mapped = mapped;
+
+    return block;
+}
+
+static void FreeBlock(arena_block_t * block)
+{
+    MemNote(MEM_SCRATCH, -(s64)(block->size + HEADER_SIZE), -1);
+
+#ifdef __linux__
+    if ( block->mapped ) {
+        munmap(block, block->mapped);
+        return;
+    }
+#endif
+    free(block);
+}
+
+arena_t NewArena(size_t block_size, bool huge_pages)
+{
+    return (arena_t){
+        .block_size = block_size ? block_size : ARENA_BLOCK_SIZE,
+        .huge_pages = huge_pages,
+    };
+}
+
+void FreeArena(arena_t * arena)
+{
+    arena_block_t * block = arena->first;
+    while ( block ) {
+        arena_block_t * next = block->next;
+        FreeBlock(block);
+        block = next;
+    }
+
+    *arena = NewArena(arena->block_size, arena->huge_pages);
+}
+
+void * ArenaAlloc(arena_t * arena, size_t size)
+{
+    size = ALIGN_UP(size, ARENA_ALIGN);
+    arena_block_t * block = arena->current;
+
+    if ( block == NULL || block->offset + size > block->size ) {
+        // move on to the next kept block that fits, or add one after the
+        // current block
+        arena_block_t * prev = block;
+        block = prev ? prev->next : arena->first;
+
+        while ( block && block->size < size ) {
+            prev = block;
+            block = block->next;
+        }
+
+        if ( block == NULL ) {
+            block = NewBlock
+            (   size > arena->block_size ? size : arena->block_size,
+                arena->huge_pages );
+            arena->reserved += block->size;
+            arena->num_blocks++;
+
+            if ( arena->current ) {
+                block->next = arena->current->next;
+                arena->current->next = block;
+            } else {
+                block->next = arena->first;
+                arena->first = block;
+            }
+        }
+
+        block->offset = 0;
+        arena->current = block;
+    }
+
+    void * ptr = BlockData(block) + block->offset;
+    block->offset += size;
+    arena->used += size;
+    if ( arena->used > arena->high_water ) {
+        arena->high_water = arena->used;
+    }
+
+    return ptr;
+}
+
+void * ArenaCalloc(arena_t * arena, size_t count, size_t size)
+{
+    void * ptr = ArenaAlloc(arena, count * size);
+    memset(ptr, 0, count * size);
+
+    return ptr;
+}
+
+char * ArenaVPrintf(arena_t * arena, const char * format, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+
+    char * buffer = ArenaAlloc(arena, len + 1);
+    vsnprintf(buffer, len + 1, format, args);
+
+    return buffer;
+}
+
+char * ArenaPrintf(arena_t * arena, const char * format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    char * buffer = ArenaVPrintf(arena, format, args);
+    va_end(args);
+
+    return buffer;
+}
+
+void ResetArena(arena_t * arena)
+{
+    arena->current = NULL;
+    arena->used = 0;
+}
+
+arena_mark_t ArenaMark(const arena_t * arena)
+{
+    return (arena_mark_t){
+        .block = arena->current,
+        .offset = arena->current ? arena->current->offset : 0,
+        .used = arena->used,
+    };
+}
+
+void ArenaRelease(arena_t * arena, arena_mark_t mark)
+{
+    arena->current = mark.block;
+    if ( mark.block ) {
+        mark.block->offset = mark.offset;
+    }
+    arena->used = mark.used;
+}
+
+#pragma mark - VECTOR
+
+void * GrowVector
+(   void * data,
+    int * capacity,
+    int min_capacity,
+    size_t element_size,
+    arena_t * arena )
+{
+    int new_capacity = *capacity ? *capacity * 2 : 8;
+    while ( new_capacity < min_capacity ) {
+        new_capacity *= 2;
+    }
+
+    size_t size = (size_t)new_capacity * element_size;
+
+    if ( arena ) {
+        // the old array is left in the arena
+        void * new_data = ArenaAlloc(arena, size);
+        if ( data ) {
+            memcpy(new_data, data, (size_t)*capacity * element_size);
+        }
+        data = new_data;
+    } else {
+        data = MemRealloc(MEM_OTHER, data, size);
+        if ( data == NULL ) {
+            Error("out of memory (%zu bytes)", size);
+        }
+    }
+
+    *capacity = new_capacity;
+
+    return data;
+}
+
+#pragma mark - HASH MAP
+
+#define MAP_EMPTY 0
+#define MAP_REMOVED 1
+#define MAP_MIN_CAPACITY 16
+
+// Finalizer from SplitMix64, so that sequential keys spread out.
+static u64 HashInteger(u64 key)
+{
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ull;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBull;
+    key ^= key >> 31;
+
+    return key;
+}
+
+// Keep hashes clear of the empty and removed markers.
+static u64 EntryHash(u64 hash)
+{
+    return hash < 2 ? hash + 2 : hash;
+}
+
+static bool KeysEqual(const hashmap_t * map, u64 a, u64 b)
+{
+    if ( map->string_keys ) {
+        return strcmp((const char *)(uintptr_t)a, (const char *)(uintptr_t)b) == 0;
+    }
+
+    return a == b;
+}
+
+static map_entry_t * AllocEntries(int capacity, arena_t * arena)
+{
+    size_t size = capacity * sizeof(map_entry_t);
+    map_entry_t * entries;
+
+    if ( arena ) {
+        entries = ArenaCalloc(arena, capacity, sizeof(map_entry_t));
+    } else {
+        entries = MemCalloc(MEM_OTHER, capacity, sizeof(map_entry_t));
+    }
+
+    if ( entries == NULL ) {
+        Error("out of memory (%zu bytes)", size);
+    }
+
+    return entries;
+}
+
+// Find the entry for `key`, or if it's not there, the slot to put it in.
+static map_entry_t * FindEntry(const hashmap_t * map, u64 key, u64 hash)
+{
+    u32 mask = map->capacity - 1;
+    map_entry_t * slot = NULL; // the first tombstone seen
+
+    for ( u32 i = hash & mask; ; i = (i + 1) & mask ) {
+        map_entry_t * e = &map->entries[i];
+
+        if ( e->hash == MAP_EMPTY ) {
+            return slot ? slot : e;
+        } else if ( e->hash == MAP_REMOVED ) {
+            if ( slot == NULL ) {
+                slot = e;
+            }
+        } else if ( e->hash == hash && KeysEqual(map, e->key, key) ) {
+            return e;
+        }
+    }
+}
+
+static void Rehash(hashmap_t * map, int capacity)
+{
+    map_entry_t * old = map->entries;
+    int old_capacity = map->capacity;
+
+    map->entries = AllocEntries(capacity, map->arena);
+    map->capacity = capacity;
+    map->removed = 0;
+
+    for ( int i = 0; i < old_capacity; i++ ) {
+        if ( old[i].hash >= 2 ) {
+            *FindEntry(map, old[i].key, old[i].hash) = old[i];
+        }
+    }
+
+    if ( map->arena == NULL ) {
+        MemFree(old);
+    }
+}
+
+static void * Get(const hashmap_t * map, u64 key, u64 hash)
+{
+    if ( map->count == 0 ) {
+        return NULL;
+    }
+
+    map_entry_t * e = FindEntry(map, key, hash);
+
+    return e->hash >= 2 ? e->value : NULL;
+}
+
+static void Put(hashmap_t * map, u64 key, u64 hash, void * value)
+{
+    // keep the load, tombstones included, under 3/4
+    if ( (map->count + map->removed + 1) * 4 > map->capacity * 3 ) {
+        int capacity = map->capacity ? map->capacity : MAP_MIN_CAPACITY;
+        if ( (map->count + 1) * 2 > capacity ) {
+            capacity *= 2; // otherwise, just clear out the tombstones
+        }
+        Rehash(map, capacity);
+    }
+
+    map_entry_t * e = FindEntry(map, key, hash);
+
+    if ( e->hash < 2 ) {
+        if ( map->string_keys ) {
+            const char * string = (const char *)(uintptr_t)key;
+            char * copy = map->arena
+                ? ArenaAlloc(map->arena, strlen(string) + 1)
+                : MemAlloc(MEM_OTHER, strlen(string) + 1);
+
+            if ( copy == NULL ) {
+                Error("out of memory");
+            }
+
+            key = (u64)(uintptr_t)strcpy(copy, string);
+        }
+
+        if ( e->hash == MAP_REMOVED ) {
+            map->removed--;
+        }
+
+        e->hash = hash;
+        e->key = key;
+        map->count++;
+    }
+
+    e->value = value;
+}
+
+static bool Remove(hashmap_t * map, u64 key, u64 hash)
+{
+    if ( map->count == 0 ) {
+        return false;
+    }
+
+    map_entry_t * e = FindEntry(map, key, hash);
+
+    if ( e->hash < 2 ) {
+        return false;
+    }
+
+    if ( map->string_keys && map->arena == NULL ) {
+        MemFree((char *)(uintptr_t)e->key);
+    }
+
+    *e = (map_entry_t){ .hash = MAP_REMOVED };
+    map->count--;
+    map->removed++;
+
+    return true;
+}
+
+hashmap_t NewHashMap(bool string_keys, arena_t * arena)
+{
+    return (hashmap_t){ .string_keys = string_keys, .arena = arena };
+}
+
+void ClearHashMap(hashmap_t * map)
+{
+    if ( map->string_keys && map->arena == NULL ) {
+        for ( map_entry_t * e = NULL; (e = MapNext(map, e)); ) {
+            MemFree((char *)(uintptr_t)e->key);
+        }
+    }
+
+    if ( map->entries ) {
+        memset(map->entries, 0, map->capacity * sizeof(*map->entries));
+    }
+
+    map->count = 0;
+    map->removed = 0;
+}
+
+void FreeHashMap(hashmap_t * map)
+{
+    ClearHashMap(map);
+
+    if ( map->arena == NULL ) {
+        MemFree(map->entries);
+    }
+
+    *map = NewHashMap(map->string_keys, map->arena);
+}
+
+void * MapGet(const hashmap_t * map, u64 key)
+{
+    return Get(map, key, EntryHash(HashInteger(key)));
+}
+
+void MapPut(hashmap_t * map, u64 key, void * value)
+{
+    Put(map, key, EntryHash(HashInteger(key)), value);
+}
+
+bool MapRemove(hashmap_t * map, u64 key)
+{
+    return Remove(map, key, EntryHash(HashInteger(key)));
+}
+
+static u64 HashString(const char * string)
+{
+    return EntryHash(HashBytes(string, strlen(string), FNV_OFFSET));
+}
+
+void * MapGetString(const hashmap_t * map, const char * key)
+{
+    return Get(map, (u64)(uintptr_t)key, HashString(key));
+}
+
+void MapPutString(hashmap_t * map, const char * key, void * value)
+{
+    Put(map, (u64)(uintptr_t)key, HashString(key), value);
+}
+
+bool MapRemoveString(hashmap_t * map, const char * key)
+{
+    return Remove(map, (u64)(uintptr_t)key, HashString(key));
+}
+
+map_entry_t * MapNext(const hashmap_t * map, map_entry_t * entry)
 {
-    struct timeval timeval;
-    static long seconds = 0;
+    map_entry_t * end = map->entries + map->capacity;
+    map_entry_t * e = entry ? entry + 1 : map->entries;
 
-    gettimeofday(&timeval, NULL);
-    if ( seconds == 0 ) {
-        seconds = timeval.tv_sec;
-        return timeval.tv_usec / 1000000.0f;
+    for ( ; e < end; e++ ) {
+        if ( e->hash >= 2 ) {
+            return e;
+        }
     }
 
-    return (timeval.tv_sec - seconds) + timeval.tv_usec / 1000000.0f;
+    return NULL;
 }
@@ -40,11 +40,6 @@ extern "C" {
         SDL_Rect: print_sdl_rect    \
     )(#var, var)
 
-// Check how many ms a bit of code takes.
-// Don't use this more than once per function...
-#define PROFILE_START int __start_ms__ = SDL_GetTicks();
-#define PROFILE_END(str) printf(str" took %d ms\n", SDL_GetTicks()-__start_ms__);
-
 #define Error(...) { fprintf(stderr, "%s: ", __func__); \
                      fprintf(stderr, __VA_ARGS__);      \
                      fprintf(stderr, "\n");             \
@@ -74,7 +69,7 @@ extern "C" {
 
 #define STACK(T, name, size)    STORAGE(T, name, size)
 #define PUSH(stack, value)      APPEND(stack, value)
-#define POP(stack)              stack.data[--s.count]
+#define POP(stack)              stack.data[--stack.count]
 
 //
 // Integer Types
@@ -107,8 +102,225 @@ PRINT_DECL(print_sdl_rect, SDL_Rect);
 /// - Returns: The opened file.
 FILE * OpenFile( const char * file_name, const char * mode );
 
-/// The time since program start in fractional seconds.
-float ProgramTime(void);
+/// 64-bit FNV-1a hash of `size` bytes at `data`.
+/// - Parameter hash: The hash to continue from, or `FNV_OFFSET` to start
+///   a new one. This allows hashing several separate values as one.
+u64 HashBytes(const void * data, size_t size, u64 hash);
+
+#define FNV_OFFSET 0xCBF29CE484222325ull
+
+//
+// Memory Tracking
+// Opt-in accounting of heap memory by subsystem. Allocations made with
+// the Mem* functions carry a small header with their tag and size while
+// tracking is on; with it off they go straight to malloc and free.
+//
+
+typedef enum {
+    MEM_OTHER,
+    MEM_VIDEO,      // framebuffer and draw batches
+    MEM_TEXTURE,    // estimated size of SDL textures, see `MemNote()`
+    MEM_TEXT,
+    MEM_GENERATION, // world, tile, mip and chunk buffers
+    MEM_CACHE,
+    MEM_SCRATCH,    // arena blocks
+    NUM_MEM_TAGS
+} mem_tag_t;
+
+typedef struct {
+    s64 bytes;
+    s64 peak_bytes;
+    s64 count;      // live allocations
+    s64 peak_count;
+    s64 total;      // allocations ever made
+} mem_stats_t;
+
+/// Turn on tracking. This must happen before the first Mem* allocation,
+/// as frees must know whether there's a header.
+void EnableMemoryTracking(void);
+bool MemoryTracking(void);
+
+/// Like `malloc()`, `calloc()`, `realloc()` and `free()`, accounted
+/// under `tag`. If an allocation fails while tracking, the report is
+/// printed to stderr before returning `NULL`.
+void * MemAlloc(mem_tag_t tag, size_t size);
+void * MemCalloc(mem_tag_t tag, size_t count, size_t size);
+void * MemRealloc(mem_tag_t tag, void * ptr, size_t size);
+void MemFree(void * ptr);
+
+/// Account for memory not allocated with Mem*, e.g. GPU memory.
+/// - Parameter bytes: Positive when allocated, negative when freed.
+/// - Parameter count: Likewise, the number of allocations.
+void MemNote(mem_tag_t tag, s64 bytes, int count);
+
+/// Account for an SDL texture under `MEM_TEXTURE`, estimated from its
+/// size and format. Call after creating and before destroying it.
+void MemNoteTexture(SDL_Texture * texture, bool created);
+
+mem_stats_t MemStats(mem_tag_t tag);
+void PrintMemoryReport(FILE * file);
+
+//
+// Arena
+// A bump allocator for short-lived memory. Allocations are freed all at
+// once, either with ResetArena() or by going back to an ArenaMark().
+// Blocks are kept after a reset, so an arena that has warmed up doesn't
+// touch the heap again. Arenas are not thread safe: give each thread its
+// own.
+//
+
+#define ARENA_ALIGN 64 // enough for any SIMD load
+#define ARENA_BLOCK_SIZE (256 * 1024) // default minimum block size
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+typedef struct arena_block arena_block_t;
+
+typedef struct {
+    arena_block_t * first;
+    arena_block_t * current;
+    size_t block_size;  // minimum size of new blocks
+    bool huge_pages;    // back blocks of ARENA_HUGE_PAGE_SIZE or more with
+                        // huge pages, where supported
+    size_t used;        // bytes allocated since the last reset
+    size_t high_water;  // the most `used` has ever been
+    size_t reserved;    // bytes held in blocks
+    int num_blocks;
+} arena_t;
+
+// a position in an arena to go back to
+typedef struct {
+    arena_block_t * block;
+    size_t offset;
+    size_t used;
+} arena_mark_t;
+
+/// Transient memory for the main thread, reset at the start of each frame.
+/// Anything allocated from it is gone by the next frame.
+extern arena_t frame_arena;
+
+/// - Parameter block_size: The minimum size of blocks, or 0 for
+///   `ARENA_BLOCK_SIZE`. Nothing is allocated until the first `ArenaAlloc()`.
+arena_t NewArena(size_t block_size, bool huge_pages);
+
+/// Free all of the arena's memory.
+void FreeArena(arena_t * arena);
+
+/// Allocate `size` bytes, aligned to `ARENA_ALIGN`. Terminates the program
+/// if out of memory.
+void * ArenaAlloc(arena_t * arena, size_t size);
+
+/// `ArenaAlloc()`, zeroed.
+void * ArenaCalloc(arena_t * arena, size_t count, size_t size);
+
+/// Format a string into the arena, like `asprintf()`.
+char * ArenaPrintf(arena_t * arena, const char * format, ...);
+char * ArenaVPrintf(arena_t * arena, const char * format, va_list args);
+
+/// Free everything allocated, keeping the blocks for reuse.
+void ResetArena(arena_t * arena);
+
+/// Get the current position, to free everything allocated after it with
+/// `ArenaRelease()`. Use for per-job or per-call scopes:
+///
+///     arena_mark_t mark = ArenaMark(&arena);
+///     float * row = ArenaAlloc(&arena, w * sizeof(*row));
+///     ...
+///     ArenaRelease(&arena, mark);
+arena_mark_t ArenaMark(const arena_t * arena);
+void ArenaRelease(arena_t * arena, arena_mark_t mark);
+
+//
+// Vector
+// A growable array of any type. Memory comes from the heap, or from an
+// arena if `.arena` is set before the first push.
+//
+//     VECTOR(SDL_Point) points = { 0 };
+//     VectorPush(points, ((SDL_Point){ 1, 2 }));
+//     for ( int i = 0; i < points.count; i++ ) ...
+//     VectorFree(points);
+//
+
+#define VECTOR(T) struct { T * data; int count; int capacity; arena_t * arena; }
+
+/// Make sure there's room for `n` elements.
+#define VectorReserve(vec, n) \
+    (void)( (n) <= (vec).capacity \
+        || ((vec).data = GrowVector((vec).data, \
+                                    &(vec).capacity, \
+                                    (n), \
+                                    sizeof(*(vec).data), \
+                                    (vec).arena), 1) )
+
+#define VectorPush(vec, value)  ( VectorReserve(vec, (vec).count + 1), \
+                                  (vec).data[(vec).count++] = (value) )
+#define VectorPop(vec)          (vec).data[--(vec).count]
+#define VectorLast(vec)         (vec).data[(vec).count - 1]
+#define VectorClear(vec)        (vec).count = 0
+// remove element i by moving the last element into its place
+#define VectorRemove(vec, i)    (vec).data[i] = (vec).data[--(vec).count]
+#define VectorFree(vec)         { if ( (vec).arena == NULL ) MemFree((vec).data); \
+                                  (vec).data = NULL; \
+                                  (vec).count = (vec).capacity = 0; }
+
+/// Used by `VectorReserve()`.
+/// - Returns: `data`, reallocated to hold at least `min_capacity` elements.
+void * GrowVector
+(   void * data,
+    int * capacity,
+    int min_capacity,
+    size_t element_size,
+    arena_t * arena );
+
+//
+// Hash Map
+// Open addressing with linear probing, mapping integer or string keys to
+// pointers. String keys are copied. With an arena, the table and keys are
+// allocated from it and nothing is freed until the arena is.
+//
+
+typedef struct {
+    u64 hash;  // 0: empty, 1: removed
+    u64 key;   // the integer key, or the string key's address
+    void * value;
+} map_entry_t;
+
+typedef struct {
+    map_entry_t * entries;
+    int capacity;   // a power of two
+    int count;
+    int removed;    // tombstones, which count toward the load factor
+    bool string_keys;
+    arena_t * arena;
+} hashmap_t;
+
+/// - Parameter string_keys: Use the `*String()` functions with this map
+///   instead of the integer ones.
+/// - Parameter arena: Where to allocate from, or `NULL` for the heap.
+hashmap_t NewHashMap(bool string_keys, arena_t * arena);
+void FreeHashMap(hashmap_t * map);
+
+/// Remove all entries, keeping the table.
+void ClearHashMap(hashmap_t * map);
+
+/// - Returns: The value for `key`, or `NULL` if there isn't one.
+void * MapGet(const hashmap_t * map, u64 key);
+
+/// Add or replace the value for `key`. `value` should not be `NULL`.
+void MapPut(hashmap_t * map, u64 key, void * value);
+
+/// - Returns: Whether there was a value to remove.
+bool MapRemove(hashmap_t * map, u64 key);
+
+void * MapGetString(const hashmap_t * map, const char * key);
+void MapPutString(hashmap_t * map, const char * key, void * value);
+bool MapRemoveString(hashmap_t * map, const char * key);
+
+/// Iterate over entries, in no particular order:
+///
+///     for ( map_entry_t * e = NULL; (e = MapNext(&map, e)); ) ...
+///
+/// String keys are `(const char *)(uintptr_t)e->key`.
+map_entry_t * MapNext(const hashmap_t * map, map_entry_t * entry);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -91,6 +91,10 @@ float RandomFloat(float min, float max);
 
 #pragma mark - NOISE
 
+// Bump this whenever a change to the noise functions alters their output,
+// so that anything persisted from an older version is thrown out.
+#define NOISE_VERSION 1
+
 void RandomizeNoise(u32 seed);
 
 /// Perlin noise at point x, y, z.
@@ -0,0 +1,189 @@
+#include "profiler.h"
+#include "mathlib.h"
+
+typedef struct {
+    const char * name;
+    u64 start;
+    u64 duration;
+} zone_event_t;
+
+// One thread's zones. Only that thread writes to it, so the only tricky
+// part is saving a trace while it does: `writing` is set before a slot is
+// overwritten, so a reader can tell which of what it copied is intact.
+typedef struct {
+    zone_event_t events[PROFILE_RING_SIZE];
+    u64 head;       // zones recorded
+    u64 writing;    // head + 1 while writing the next one
+    int id;
+    char name[32];
+} zone_ring_t;
+
+bool profiler_enabled;
+static u64 trace_start;
+
+static zone_ring_t * rings[MAX_PROFILE_THREADS];
+static SDL_atomic_t num_rings;
+static _Thread_local zone_ring_t * ring;
+static _Thread_local char thread_name[32];
+
+static zone_ring_t * ThreadRing(void)
+{
+    if ( ring ) {
+        return ring;
+    }
+
+    int index = SDL_AtomicAdd(&num_rings, 1);
+    if ( index >= MAX_PROFILE_THREADS ) {
+        Error("too many profiled threads");
+    }
+
+    ring = MemCalloc(MEM_OTHER, 1, sizeof(*ring));
+    if ( ring == NULL ) {
+        Error("out of memory");
+    }
+
+    ring->id = index + 1;
+    if ( thread_name[0] ) {
+        snprintf(ring->name, sizeof(ring->name), "%s", thread_name);
+    } else {
+        snprintf(ring->name, sizeof(ring->name), "thread %d", ring->id);
+    }
+
+    __atomic_store_n(&rings[index], ring, __ATOMIC_RELEASE);
+
+    return ring;
+}
+
+// Copy out the zones of `r` that weren't overwritten while copying.
+// - Returns: The number of zones put in `out`.
+static int CopyRing(zone_ring_t * r, zone_event_t * out)
+{
+    u64 end = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    u64 begin = end > PROFILE_RING_SIZE ? end - PROFILE_RING_SIZE : 0;
+
+    for ( u64 i = begin; i < end; i++ ) {
+        zone_event_t * event = &r->events[i % PROFILE_RING_SIZE];
+        zone_event_t * copy = &out[i - begin];
+        copy->name = __atomic_load_n(&event->name, __ATOMIC_RELAXED);
+        copy->start = __atomic_load_n(&event->start, __ATOMIC_RELAXED);
+        copy->duration = __atomic_load_n(&event->duration, __ATOMIC_RELAXED);
+    }
+
+    // If any of that was being overwritten, `writing` has moved past it.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    u64 writing = __atomic_load_n(&r->writing, __ATOMIC_RELAXED);
+    u64 first_intact = writing > PROFILE_RING_SIZE ? writing - PROFILE_RING_SIZE : 0;
+
+    if ( first_intact <= begin ) {
+        return (int)(end - begin);
+    }
+
+    u64 skip = MIN(first_intact, end) - begin;
+    memmove(out, out + skip, (end - begin - skip) * sizeof(*out));
+
+    return (int)(end - begin - skip);
+}
+
+static void WriteString(FILE * file, const char * string)
+{
+    fputc('"', file);
+
+    for ( const char * c = string; *c; c++ ) {
+        if ( *c == '"' || *c == '\\' ) {
+            fputc('\\', file);
+            fputc(*c, file);
+        } else if ( (unsigned char)*c < 0x20 ) {
+            fprintf(file, "\\u%04x", *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+#pragma mark - PUBLIC FUNCTIONS
+
+void SetProfiling(bool enabled)
+{
+    if ( enabled && trace_start == 0 ) {
+        trace_start = Now();
+    }
+
+    __atomic_store_n(&profiler_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+void SetProfilerThreadName(const char * name)
+{
+    snprintf(thread_name, sizeof(thread_name), "%s", name);
+}
+
+void RecordZone(const zone_t * zone)
+{
+    u64 end = Now();
+    zone_ring_t * r = ThreadRing();
+    u64 head = r->head;
+
+    __atomic_store_n(&r->writing, head + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    zone_event_t * event = &r->events[head % PROFILE_RING_SIZE];
+    __atomic_store_n(&event->name, zone->name, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->start, zone->start, __ATOMIC_RELAXED);
+    __atomic_store_n(&event->duration, end - zone->start, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+bool SaveChromeTrace(const char * path)
+{
+    FILE * file = fopen(path, "w");
+    if ( file == NULL ) {
+        return false;
+    }
+
+    zone_event_t * events = MemAlloc(MEM_OTHER, PROFILE_RING_SIZE * sizeof(*events));
+    if ( events == NULL ) {
+        Error("out of memory");
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+    int count = MIN(SDL_AtomicGet(&num_rings), MAX_PROFILE_THREADS);
+    bool first = true;
+
+    for ( int i = 0; i < count; i++ ) {
+        zone_ring_t * r = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+        if ( r == NULL ) {
+            continue; // still being set up
+        }
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", r->id);
+        WriteString(file, r->name);
+        fprintf(file, "}}");
+        first = false;
+
+        int num_events = CopyRing(r, events);
+
+        // timestamps are in microseconds
+        for ( int j = 0; j < num_events; j++ ) {
+            zone_event_t * event = &events[j];
+            fprintf(file, ",\n{\"name\":");
+            WriteString(file, event->name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                    "\"ts\":%.3f,\"dur\":%.3f}",
+                    r->id,
+                    NsToUs(event->start - trace_start),
+                    NsToUs(event->duration));
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    MemFree(events);
+
+    return fclose(file) == 0;
+}
+
+extern inline zone_t BeginZone(const char * name);
+extern inline void EndZone(zone_t * zone);
@@ -0,0 +1,88 @@
+// -----------------------------------------------------------------------------
+// Profiler
+//
+// Named zones of code, recorded per thread and saved as a Chrome trace
+// (load it in chrome://tracing or ui.perfetto.dev). A zone lasts from the
+// `ZONE()` to the end of its block, and zones nest:
+//
+//     void DrawScene(void)
+//     {
+//         ZONE("draw scene");
+//         for ( int i = 0; i < count; i++ ) {
+//             ZONE("draw sprite");
+//             ...
+//         }
+//     }
+//
+// Each thread writes finished zones to its own ring buffer, without locks,
+// overwriting its oldest ones once it's full. Saving a trace reads the
+// rings while they're being written to.
+//
+// Recording is off until `SetProfiling(true)`; until then a zone costs a
+// load and a branch. Building with -DNO_PROFILER removes zones entirely.
+// -----------------------------------------------------------------------------
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "genlib.h"
+#include "timing.h"
+
+#define MAX_PROFILE_THREADS 128
+#define PROFILE_RING_SIZE   (16 * 1024) // zones kept per thread
+
+typedef struct {
+    const char * name; // must stay valid until the trace is saved
+    u64 start;         // Now(), or 0 if not recording
+} zone_t;
+
+#define ZONE_NAME2(n) _zone_##n
+#define ZONE_NAME(n) ZONE_NAME2(n)
+
+#ifdef NO_PROFILER
+#define ZONE(name)
+#define ZONE_BEGIN(zone, name)
+#define ZONE_END(zone)
+#else
+/// Record the rest of the enclosing block as a zone.
+#define ZONE(name) \
+    zone_t ZONE_NAME(__COUNTER__) \
+    __attribute__((cleanup(EndZone))) = BeginZone(name)
+
+/// For zones that don't match a block. Pairs must nest properly.
+#define ZONE_BEGIN(zone, name)  zone_t zone = BeginZone(name)
+#define ZONE_END(zone)          EndZone(&zone)
+#endif
+
+extern bool profiler_enabled;
+
+/// Start or stop recording zones. Zones already started still finish.
+void SetProfiling(bool enabled);
+
+/// Name the calling thread in traces. Threads are otherwise "thread <n>",
+/// in the order they first recorded a zone.
+void SetProfilerThreadName(const char * name);
+
+/// Write every thread's recorded zones as Chrome trace_event JSON.
+/// - Returns: `false` if the file couldn't be written.
+bool SaveChromeTrace(const char * path);
+
+/// Record a zone that ended just now.
+void RecordZone(const zone_t * zone);
+
+inline zone_t BeginZone(const char * name)
+{
+    if ( !__atomic_load_n(&profiler_enabled, __ATOMIC_RELAXED) ) {
+        return (zone_t){ name, 0 };
+    }
+
+    return (zone_t){ name, Now() };
+}
+
+inline void EndZone(zone_t * zone)
+{
+    if ( zone->start ) {
+        RecordZone(zone);
+    }
+}
+
+#endif /* __PROFILER_H__ */
@@ -0,0 +1,129 @@
+#include "resultqueue.h"
+
+// Dmitry Vyukov's bounded queue. Each cell's sequence number says whose
+// turn it is: a producer may fill cell i when its sequence is i, and the
+// consumer may empty it when its sequence is i + 1. Emptying sets it to
+// i + capacity, ready for the next lap.
+
+void InitResultQueue(result_queue_t * queue, int capacity, result_func_t discard)
+{
+    size_t size = 2;
+    while ( size < (size_t)capacity ) {
+        size *= 2;
+    }
+
+    *queue = (result_queue_t){
+        .cells = MemAlloc(MEM_OTHER, size * sizeof(*queue->cells)),
+        .mask = size - 1,
+        .discard = discard,
+    };
+
+    if ( queue->cells == NULL ) {
+        Error("out of memory");
+    }
+
+    for ( size_t i = 0; i < size; i++ ) {
+        queue->cells[i].sequence = i;
+    }
+}
+
+void FreeResultQueue(result_queue_t * queue)
+{
+    NextResultGeneration(queue);
+
+    result_t result;
+    while ( PopResult(queue, &result) ) // everything is stale, so discarded
+        ;
+
+    MemFree(queue->cells);
+    *queue = (result_queue_t){ 0 };
+}
+
+bool PushResult(result_queue_t * queue, result_t result)
+{
+    size_t position = __atomic_load_n(&queue->push_position, __ATOMIC_RELAXED);
+
+    while ( true ) {
+        result_cell_t * cell = &queue->cells[position & queue->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+
+        if ( diff == 0 ) {
+            // the cell is free: claim it, unless another producer beat us
+            if ( __atomic_compare_exchange_n(&queue->push_position,
+                                             &position,
+                                             position + 1,
+                                             true,
+                                             __ATOMIC_RELAXED,
+                                             __ATOMIC_RELAXED) )
+            {
+                cell->value = result;
+                __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            // else: position was updated, try again
+        } else if ( diff < 0 ) {
+            return false; // a lap behind: full
+        } else {
+            position = __atomic_load_n(&queue->push_position, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+bool PushResultWait(result_queue_t * queue, result_t result)
+{
+    while ( !PushResult(queue, result) ) {
+        if ( result.generation != ResultGeneration(queue) ) {
+            return false;
+        }
+
+        SDL_Delay(1);
+    }
+
+    return true;
+}
+
+bool PopResult(result_queue_t * queue, result_t * result)
+{
+    while ( true ) {
+        size_t position = queue->pop_position;
+        result_cell_t * cell = &queue->cells[position & queue->mask];
+        size_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+
+        if ( sequence != position + 1 ) {
+            return false; // empty, or the producer isn't done with it yet
+        }
+
+        *result = cell->value;
+        queue->pop_position = position + 1;
+        __atomic_store_n(&cell->sequence,
+                         position + queue->mask + 1,
+                         __ATOMIC_RELEASE);
+
+        if ( result->generation == ResultGeneration(queue) ) {
+            return true;
+        }
+
+        queue->dropped++;
+        if ( queue->discard ) {
+            queue->discard(result);
+        }
+    }
+}
+
+u32 NextResultGeneration(result_queue_t * queue)
+{
+    return __atomic_add_fetch(&queue->generation, 1, __ATOMIC_RELEASE);
+}
+
+u32 ResultGeneration(const result_queue_t * queue)
+{
+    return __atomic_load_n(&queue->generation, __ATOMIC_ACQUIRE);
+}
+
+int ResultsQueued(const result_queue_t * queue)
+{
+    size_t pushed = __atomic_load_n(&queue->push_position, __ATOMIC_RELAXED);
+
+    return (int)(pushed - queue->pop_position);
+}
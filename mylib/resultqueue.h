@@ -0,0 +1,75 @@
+// -----------------------------------------------------------------------------
+// Result Queue
+//
+// Hands finished work from worker threads to the main thread, which is the
+// only one allowed to call the renderer. Any number of threads can push;
+// only the main thread pops. The queue is a fixed size ring and never
+// locks: producers claim a cell with a compare-and-swap, the consumer just
+// checks its cell's sequence number.
+//
+// Each result carries the generation it was made for. Bumping the queue's
+// generation (when the world changes, say) makes everything older stale:
+// stale results are dropped on the way out instead of being handed over.
+// -----------------------------------------------------------------------------
+#ifndef __RESULTQUEUE_H__
+#define __RESULTQUEUE_H__
+
+#include "genlib.h"
+
+typedef struct {
+    u32 generation;
+    void * handle;  // what the result is for, e.g. a chunk
+    void * buffer;  // the finished data
+} result_t;
+
+/// Called on the main thread with each result that's dropped for being
+/// stale, so that its buffer can be freed.
+typedef void (* result_func_t)(result_t * result);
+
+typedef struct {
+    result_t value;
+    size_t sequence;
+} result_cell_t;
+
+typedef struct {
+    result_cell_t * cells;
+    size_t mask;            // capacity - 1
+    size_t push_position;   // shared by producers
+    size_t pop_position;    // only used by the consumer
+    u32 generation;
+    result_func_t discard;
+    int dropped;            // stale results discarded so far
+} result_queue_t;
+
+/// - Parameter capacity: Rounded up to a power of two.
+/// - Parameter discard: Called with stale results, or `NULL`.
+void InitResultQueue(result_queue_t * queue, int capacity, result_func_t discard);
+
+/// Discard everything left in the queue and free it.
+void FreeResultQueue(result_queue_t * queue);
+
+/// Add a result without waiting.
+/// - Returns: `false` if the queue is full.
+bool PushResult(result_queue_t * queue, result_t result);
+
+/// Add a result, waiting for room if the queue is full. This is the queue's
+/// back-pressure: producers slow down to the rate the main thread drains.
+/// - Returns: `false` if the result went stale while waiting. It was not
+///   added and its buffer is still the caller's.
+bool PushResultWait(result_queue_t * queue, result_t result);
+
+/// Take the oldest result that isn't stale. Stale ones in the way are
+/// given to the discard function. Main thread only.
+/// - Returns: `false` if there's nothing left.
+bool PopResult(result_queue_t * queue, result_t * result);
+
+/// Start a new generation. Every result made for an older one is stale.
+/// - Returns: The new generation.
+u32 NextResultGeneration(result_queue_t * queue);
+
+u32 ResultGeneration(const result_queue_t * queue);
+
+/// An estimate, as producers may be pushing.
+int ResultsQueued(const result_queue_t * queue);
+
+#endif /* __RESULTQUEUE_H__ */
@@ -0,0 +1,216 @@
+#include "taskgraph.h"
+#include "mathlib.h"
+#include "profiler.h"
+
+struct graph_job {
+    task_graph_t * graph;
+    int node;
+    int tile;
+};
+
+#pragma mark -
+
+static void RunJob(void * data);
+
+// Send a job to the pool, or to the main thread.
+static void Schedule(graph_job_t * job)
+{
+    task_graph_t * graph = job->graph;
+
+    if ( graph->nodes[job->node].main_thread ) {
+        // there's room for every main thread job of the run, see below
+        result_t result = { ResultGeneration(&graph->main_jobs), job, NULL };
+        if ( !PushResult(&graph->main_jobs, result) ) {
+            Error("task graph main thread queue is full");
+        }
+        SDL_SemPost(graph->ready);
+    } else {
+        RunTask(&graph->group, RunJob, job);
+    }
+}
+
+static void RunJob(void * data)
+{
+    graph_job_t * job = data;
+    task_graph_t * graph = job->graph;
+    graph_node_t * node = &graph->nodes[job->node];
+
+    u64 start = Now();
+    {
+        ZONE(node->name);
+        node->func(job->tile, graph->data);
+    }
+    u64 ns = Now() - start;
+
+    __atomic_add_fetch(&node->ns, ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&node->runs, 1, __ATOMIC_RELAXED);
+
+    // start this tile's next stages
+    graph_job_t * tile_jobs = job - job->node;
+    for ( int i = 0; i < graph->num_nodes; i++ ) {
+        if ( graph->nodes[i].parent == job->node ) {
+            Schedule(&tile_jobs[i]);
+        }
+    }
+
+    if ( SDL_AtomicDecRef(&graph->remaining) ) {
+        SDL_SemPost(graph->ready); // that was the last one
+    }
+}
+
+#pragma mark - PUBLIC FUNCTIONS
+
+void InitTaskGraph(task_graph_t * graph, void * data)
+{
+    *graph = (task_graph_t){ .data = data };
+
+    graph->ready = SDL_CreateSemaphore(0);
+    if ( graph->ready == NULL ) {
+        Error("could not create semaphore (%s)", SDL_GetError());
+    }
+}
+
+void FreeTaskGraph(task_graph_t * graph)
+{
+    if ( graph->main_jobs.cells ) {
+        FreeResultQueue(&graph->main_jobs);
+    }
+
+    SDL_DestroySemaphore(graph->ready);
+    MemFree(graph->jobs);
+    *graph = (task_graph_t){ 0 };
+}
+
+int AddGraphNode
+(   task_graph_t * graph,
+    const char * name,
+    graph_func_t func,
+    int parent,
+    bool main_thread )
+{
+    if ( graph->num_nodes == MAX_GRAPH_NODES ) {
+        Error("too many graph nodes");
+    }
+
+    if ( parent >= graph->num_nodes ) {
+        Error("node '%s' must be added after its parent", name);
+    }
+
+    graph->nodes[graph->num_nodes] = (graph_node_t){
+        .name = name,
+        .func = func,
+        .parent = parent,
+        .main_thread = main_thread,
+    };
+
+    return graph->num_nodes++;
+}
+
+void RunTaskGraph(task_graph_t * graph, const int * tiles, int num_tiles)
+{
+    int num_nodes = graph->num_nodes;
+    int num_jobs = num_tiles * num_nodes;
+
+    if ( num_jobs == 0 ) {
+        return;
+    }
+
+    ZONE("RunTaskGraph");
+    u64 start = Now();
+
+    if ( num_jobs > graph->max_jobs ) {
+        graph->max_jobs = num_jobs;
+        graph->jobs = MemRealloc(MEM_OTHER, graph->jobs, num_jobs * sizeof(*graph->jobs));
+        if ( graph->jobs == NULL ) {
+            Error("out of memory");
+        }
+    }
+
+    // Main thread jobs are only taken off the queue by this thread, so
+    // make room for all of them: pushing must never have to wait.
+    int main_nodes = 0;
+    for ( int i = 0; i < num_nodes; i++ ) {
+        main_nodes += graph->nodes[i].main_thread;
+    }
+
+    int main_capacity = MAX(num_tiles * main_nodes, 1);
+    if ( graph->main_jobs.cells == NULL
+        || (int)graph->main_jobs.mask + 1 < main_capacity )
+    {
+        if ( graph->main_jobs.cells ) {
+            FreeResultQueue(&graph->main_jobs);
+        }
+        InitResultQueue(&graph->main_jobs, main_capacity, NULL);
+    }
+
+    for ( int t = 0; t < num_tiles; t++ ) {
+        for ( int n = 0; n < num_nodes; n++ ) {
+            graph->jobs[t * num_nodes + n] = (graph_job_t){ graph, n, tiles[t] };
+        }
+    }
+
+    SDL_AtomicSet(&graph->remaining, num_jobs);
+
+    for ( int t = 0; t < num_tiles; t++ ) {
+        for ( int n = 0; n < num_nodes; n++ ) {
+            if ( graph->nodes[n].parent == -1 ) {
+                Schedule(&graph->jobs[t * num_nodes + n]);
+            }
+        }
+    }
+
+    while ( SDL_AtomicGet(&graph->remaining) > 0 ) {
+        result_t result;
+
+        if ( PopResult(&graph->main_jobs, &result) ) {
+            RunJob(result.handle);
+        } else if ( !RunPendingTask() ) {
+            SDL_SemWait(graph->ready);
+        }
+    }
+
+    WaitTaskGroup(&graph->group); // already done, just resets it
+    while ( SDL_SemTryWait(graph->ready) == 0 ) // clear leftover posts
+        ;
+
+    graph->tiles += num_tiles;
+    graph->wall_ns += Now() - start;
+}
+
+void ResetGraphTimings(task_graph_t * graph)
+{
+    for ( int i = 0; i < graph->num_nodes; i++ ) {
+        graph->nodes[i].ns = 0;
+        graph->nodes[i].runs = 0;
+    }
+
+    graph->wall_ns = 0;
+    graph->tiles = 0;
+}
+
+void PrintGraphTimings(const task_graph_t * graph, FILE * file)
+{
+    u64 total = 0;
+
+    for ( int i = 0; i < graph->num_nodes; i++ ) {
+        total += graph->nodes[i].ns;
+    }
+
+    fprintf(file, "task graph: %d tiles\n", graph->tiles);
+    fprintf(file, "  %-12s %10s %6s %12s\n", "node", "total ms", "share", "us per tile");
+
+    for ( int i = 0; i < graph->num_nodes; i++ ) {
+        const graph_node_t * node = &graph->nodes[i];
+        fprintf(file, "  %-12s %10.3f %5.1f%% %12.2f\n",
+                node->name,
+                NsToMs(node->ns),
+                total ? 100.0 * node->ns / total : 0.0,
+                node->runs ? NsToUs(node->ns) / node->runs : 0.0);
+    }
+
+    // more than 1x means nodes ran in parallel
+    fprintf(file, "  %-12s %10.3f (%.2fx overlap)\n",
+            "wall time",
+            NsToMs(graph->wall_ns),
+            graph->wall_ns ? (double)total / graph->wall_ns : 0.0);
+}
@@ -0,0 +1,82 @@
+// -----------------------------------------------------------------------------
+// Task Graph
+//
+// Runs a pipeline of stages over a set of tiles on the task pool. Each
+// stage (node) of a tile starts as soon as the same tile's parent stage is
+// done, so the first tiles can be on a late stage while later tiles are
+// still on an early one. Nodes with the same parent run in parallel, which
+// is how extra passes, like an analysis of each tile, are added.
+//
+// Nodes marked `main_thread` are handed to the thread that called
+// `RunTaskGraph()` through a result queue, e.g. for uploading textures.
+//
+// Each node's time is added up across runs for a timing breakdown.
+// -----------------------------------------------------------------------------
+#ifndef __TASKGRAPH_H__
+#define __TASKGRAPH_H__
+
+#include "genlib.h"
+#include "resultqueue.h"
+#include "taskpool.h"
+#include "timing.h"
+
+#define MAX_GRAPH_NODES 16
+
+/// Do one stage of work for `tile`.
+typedef void (* graph_func_t)(int tile, void * data);
+
+typedef struct {
+    const char * name;
+    graph_func_t func;
+    int parent;         // -1 if the node doesn't wait for another
+    bool main_thread;
+    u64 ns;             // over all runs
+    int runs;
+} graph_node_t;
+
+typedef struct graph_job graph_job_t;
+
+typedef struct {
+    graph_node_t nodes[MAX_GRAPH_NODES];
+    int num_nodes;
+    void * data; // passed to each node's func
+    u64 wall_ns; // time spent in RunTaskGraph()
+    int tiles; // tiles run, over all runs
+
+    // used while running:
+    task_group_t group;
+    result_queue_t main_jobs;
+    SDL_sem * ready; // a main thread job was added, or the run is done
+    SDL_atomic_t remaining;
+    graph_job_t * jobs;
+    int max_jobs;
+} task_graph_t;
+
+/// - Parameter data: Passed to every node.
+void InitTaskGraph(task_graph_t * graph, void * data);
+void FreeTaskGraph(task_graph_t * graph);
+
+/// Add a stage.
+/// - Parameter parent: The node that must finish a tile before this node
+///   starts it, or -1.
+/// - Parameter main_thread: Run on the thread that called `RunTaskGraph()`
+///   rather than on the task pool.
+/// - Returns: The node's index, for use as a parent.
+int AddGraphNode
+(   task_graph_t * graph,
+    const char * name,
+    graph_func_t func,
+    int parent,
+    bool main_thread );
+
+/// Run every node on each of `tiles`, returning when all are done. Tiles
+/// are started in the given order.
+void RunTaskGraph(task_graph_t * graph, const int * tiles, int num_tiles);
+
+void ResetGraphTimings(task_graph_t * graph);
+
+/// Print each node's share of the time and average time per tile, plus
+/// how much the nodes overlapped.
+void PrintGraphTimings(const task_graph_t * graph, FILE * file);
+
+#endif /* __TASKGRAPH_H__ */
@@ -0,0 +1,470 @@
+#ifdef __linux__
+#define _GNU_SOURCE // sched_getaffinity()
+#include <sched.h>
+#endif
+
+#include "taskpool.h"
+#include "mathlib.h"
+#include "profiler.h"
+#include "timing.h"
+
+#define INITIAL_DEQUE_SIZE 256 // a power of two
+
+typedef struct {
+    task_func_t func;
+    tile_func_t tile_func; // used instead of func if set
+    SDL_Rect tile;
+    void * data;
+    task_group_t * group;
+} task_t;
+
+// Owner pushes and pops at the tail, thieves take from the head. A spin
+// lock is plenty: it's held for a few instructions and rarely contended.
+typedef struct {
+    SDL_SpinLock lock;
+    task_t * tasks;
+    u32 mask; // capacity - 1
+    u32 head;
+    u32 tail;
+    u32 rng; // for picking who to steal from
+    u64 busy_ns; // written by the worker only
+    SDL_Thread * thread;
+    char pad[64]; // keep workers off each other's cache lines
+} worker_t;
+
+static worker_t * workers;
+static int num_workers;
+static _Thread_local int worker_index = -1; // which worker this thread is
+
+static SDL_mutex * lock;
+static SDL_cond * wake; // work was added, or a group finished
+static SDL_atomic_t queued; // tasks in all deques
+static SDL_atomic_t sleeping; // threads waiting on `wake`
+static SDL_atomic_t next_deque; // where other threads add tasks
+static SDL_atomic_t quit;
+
+static SDL_atomic_t num_tasks;
+static SDL_atomic_t num_steals;
+
+#pragma mark - DEQUE
+
+static void Push(worker_t * w, task_t task)
+{
+    SDL_AtomicLock(&w->lock);
+
+    if ( w->tail - w->head > w->mask ) {
+        // full: unwrap into a buffer twice the size
+        u32 capacity = (w->mask + 1) * 2;
+        task_t * tasks = MemAlloc(MEM_OTHER, capacity * sizeof(*tasks));
+        if ( tasks == NULL ) {
+            Error("out of memory");
+        }
+
+        for ( u32 i = w->head; i != w->tail; i++ ) {
+            tasks[i & (capacity - 1)] = w->tasks[i & w->mask];
+        }
+
+        MemFree(w->tasks);
+        w->tasks = tasks;
+        w->mask = capacity - 1;
+    }
+
+    w->tasks[w->tail++ & w->mask] = task;
+    SDL_AtomicUnlock(&w->lock);
+}
+
+static bool Pop(worker_t * w, task_t * task)
+{
+    bool found = false;
+    SDL_AtomicLock(&w->lock);
+
+    if ( w->tail != w->head ) {
+        *task = w->tasks[--w->tail & w->mask];
+        found = true;
+    }
+
+    SDL_AtomicUnlock(&w->lock);
+    return found;
+}
+
+static bool Steal(worker_t * w, task_t * task)
+{
+    bool found = false;
+    SDL_AtomicLock(&w->lock);
+
+    if ( w->tail != w->head ) {
+        *task = w->tasks[w->head++ & w->mask];
+        found = true;
+    }
+
+    SDL_AtomicUnlock(&w->lock);
+    return found;
+}
+
+#pragma mark -
+
+// Get a task: this thread's newest if it's a worker, otherwise the
+// oldest of someone else's, starting from a random victim.
+static bool TakeTask(task_t * task)
+{
+    if ( SDL_AtomicGet(&queued) == 0 ) {
+        return false;
+    }
+
+    static _Thread_local u32 rng = 0x9E3779B9;
+    u32 * seed = worker_index >= 0 ? &workers[worker_index].rng : &rng;
+
+    if ( worker_index >= 0 && Pop(&workers[worker_index], task) ) {
+        SDL_AtomicAdd(&queued, -1);
+        return true;
+    }
+
+    // xorshift
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+
+    for ( int i = 0; i < num_workers; i++ ) {
+        int victim = (*seed + i) % num_workers;
+
+        if ( victim != worker_index && Steal(&workers[victim], task) ) {
+            SDL_AtomicAdd(&queued, -1);
+            if ( worker_index >= 0 ) {
+                SDL_AtomicIncRef(&num_steals);
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void Finish(task_group_t * group)
+{
+    if ( SDL_AtomicDecRef(&group->pending) && lock ) {
+        // last one: wake anyone waiting on the group
+        SDL_LockMutex(lock);
+        SDL_CondBroadcast(wake);
+        SDL_UnlockMutex(lock);
+    }
+}
+
+static void Execute(const task_t * task)
+{
+    if ( !SDL_AtomicGet(&task->group->cancelled) ) {
+        if ( task->tile_func ) {
+            task->tile_func(task->tile, task->data);
+        } else {
+            task->func(task->data);
+        }
+    }
+
+    SDL_AtomicIncRef(&num_tasks);
+    Finish(task->group);
+}
+
+static void Submit(task_t task)
+{
+    SDL_AtomicIncRef(&task.group->pending);
+
+    if ( num_workers == 0 ) {
+        Execute(&task);
+        return;
+    }
+
+    int index = worker_index;
+    if ( index < 0 ) {
+        index = (u32)SDL_AtomicAdd(&next_deque, 1) % num_workers;
+    }
+
+    Push(&workers[index], task);
+    SDL_AtomicIncRef(&queued);
+
+    // Sleepers count themselves before checking `queued`, and `queued` was
+    // counted before checking for sleepers, so one of us sees the other.
+    if ( SDL_AtomicGet(&sleeping) > 0 ) {
+        SDL_LockMutex(lock);
+        SDL_CondSignal(wake);
+        SDL_UnlockMutex(lock);
+    }
+}
+
+static int Worker(void * data)
+{
+    worker_index = (int)(intptr_t)data;
+    task_t task;
+
+    char name[32];
+    snprintf(name, sizeof(name), "task worker %d", worker_index + 1);
+    SetProfilerThreadName(name);
+
+    while ( !SDL_AtomicGet(&quit) ) {
+        if ( TakeTask(&task) ) {
+            worker_t * w = &workers[worker_index];
+            u64 start = Now();
+            Execute(&task);
+            __atomic_store_n(&w->busy_ns, w->busy_ns + Now() - start, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        SDL_LockMutex(lock);
+        SDL_AtomicIncRef(&sleeping);
+
+        while ( SDL_AtomicGet(&queued) == 0 && !SDL_AtomicGet(&quit) ) {
+            SDL_CondWait(wake, lock);
+        }
+
+        SDL_AtomicAdd(&sleeping, -1);
+        SDL_UnlockMutex(lock);
+    }
+
+    return 0;
+}
+
+#pragma mark - WORKER COUNT
+
+#ifdef __linux__
+// Read a cgroup CPU quota as a CPU count (rounded up), or 0 if there's
+// no limit or no cgroup.
+static int CgroupCPUs(void)
+{
+    long long quota = -1;
+    long long period = 0;
+
+    // cgroup v2: "max 100000" or "<quota> <period>", in our own cgroup
+    char path[512] = "/sys/fs/cgroup/cpu.max";
+    FILE * file = fopen("/proc/self/cgroup", "r");
+    if ( file ) {
+        char line[400];
+        while ( fgets(line, sizeof(line), file) ) {
+            if ( strncmp(line, "0::", 3) == 0 ) {
+                line[strcspn(line, "\n")] = '\0';
+                snprintf(path, sizeof(path),
+                         "/sys/fs/cgroup%s/cpu.max", line + 3);
+                break;
+            }
+        }
+        fclose(file);
+    }
+
+    if ( (file = fopen(path, "r"))
+        || (file = fopen("/sys/fs/cgroup/cpu.max", "r")) )
+    {
+        char max[32];
+        if ( fscanf(file, "%31s %lld", max, &period) == 2
+            && strcmp(max, "max") != 0 )
+        {
+            quota = atoll(max);
+        }
+        fclose(file);
+    } else if ( (file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r")) ) {
+        // cgroup v1: -1 means no limit
+        if ( fscanf(file, "%lld", &quota) != 1 ) {
+            quota = -1;
+        }
+        fclose(file);
+
+        if ( (file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r")) ) {
+            if ( fscanf(file, "%lld", &period) != 1 ) {
+                period = 0;
+            }
+            fclose(file);
+        }
+    }
+
+    if ( quota <= 0 || period <= 0 ) {
+        return 0;
+    }
+
+    return (int)((quota + period - 1) / period);
+}
+#endif
+
+int DefaultWorkerCount(void)
+{
+    int count = SDL_GetCPUCount();
+
+#ifdef __linux__
+    cpu_set_t set;
+    if ( sched_getaffinity(0, sizeof(set), &set) == 0 ) {
+        count = MIN(count, CPU_COUNT(&set));
+    }
+
+    int quota = CgroupCPUs();
+    if ( quota > 0 ) {
+        count = MIN(count, quota);
+    }
+#endif
+
+    return MIN(MAX(count, 1), MAX_TASK_WORKERS);
+}
+
+#pragma mark - PUBLIC FUNCTIONS
+
+void InitTaskPool(int count)
+{
+    if ( workers ) {
+        Error("task pool already running");
+    }
+
+    num_workers = count > 0 ? MIN(count, MAX_TASK_WORKERS) : DefaultWorkerCount();
+    workers = MemCalloc(MEM_OTHER, num_workers, sizeof(*workers));
+    lock = SDL_CreateMutex();
+    wake = SDL_CreateCond();
+
+    if ( workers == NULL || lock == NULL || wake == NULL ) {
+        Error("could not create task pool (%s)", SDL_GetError());
+    }
+
+    SDL_AtomicSet(&quit, 0);
+    SDL_AtomicSet(&num_tasks, 0);
+    SDL_AtomicSet(&num_steals, 0);
+
+    for ( int i = 0; i < num_workers; i++ ) {
+        worker_t * w = &workers[i];
+        w->tasks = MemAlloc(MEM_OTHER, INITIAL_DEQUE_SIZE * sizeof(*w->tasks));
+        w->mask = INITIAL_DEQUE_SIZE - 1;
+        w->rng = 0x9E3779B9 * (i + 1);
+
+        if ( w->tasks == NULL ) {
+            Error("out of memory");
+        }
+    }
+
+    // start threads after every deque exists, as they steal from each other
+    for ( int i = 0; i < num_workers; i++ ) {
+        void * index = (void *)(intptr_t)i;
+        workers[i].thread = SDL_CreateThread(Worker, "task worker", index);
+
+        if ( workers[i].thread == NULL ) {
+            Error("could not create task worker (%s)", SDL_GetError());
+        }
+    }
+}
+
+void ShutdownTaskPool(void)
+{
+    if ( workers == NULL ) {
+        return;
+    }
+
+    SDL_LockMutex(lock);
+    SDL_AtomicSet(&quit, 1);
+    SDL_CondBroadcast(wake);
+    SDL_UnlockMutex(lock);
+
+    for ( int i = 0; i < num_workers; i++ ) {
+        SDL_WaitThread(workers[i].thread, NULL);
+        MemFree(workers[i].tasks);
+    }
+
+    SDL_DestroyCond(wake);
+    SDL_DestroyMutex(lock);
+    MemFree(workers);
+
+    workers = NULL;
+    num_workers = 0;
+    // Tasks now run inline. Finish() checks `lock` so it doesn't signal a
+    // destroyed condition variable.
+    lock = NULL;
+    wake = NULL;
+    SDL_AtomicSet(&queued, 0);
+}
+
+void RunTask(task_group_t * group, task_func_t func, void * data)
+{
+    Submit((task_t){ .func = func, .data = data, .group = group });
+}
+
+void ParallelForTiles
+(   task_group_t * group,
+    SDL_Rect area,
+    int tile_w,
+    int tile_h,
+    tile_func_t func,
+    void * data )
+{
+    for ( int y = area.y; y < area.y + area.h; y += tile_h ) {
+        for ( int x = area.x; x < area.x + area.w; x += tile_w ) {
+            task_t task = {
+                .tile_func = func,
+                .tile = {
+                    x,
+                    y,
+                    MIN(tile_w, area.x + area.w - x),
+                    MIN(tile_h, area.y + area.h - y)
+                },
+                .data = data,
+                .group = group,
+            };
+
+            Submit(task);
+        }
+    }
+}
+
+void WaitTaskGroup(task_group_t * group)
+{
+    task_t task;
+
+    while ( SDL_AtomicGet(&group->pending) > 0 ) {
+        // help out instead of just waiting
+        if ( TakeTask(&task) ) {
+            Execute(&task);
+            continue;
+        }
+
+        // The group's last tasks are running elsewhere. Sleep until one
+        // finishes the group, or more work shows up.
+        SDL_LockMutex(lock);
+        SDL_AtomicIncRef(&sleeping);
+
+        while ( SDL_AtomicGet(&group->pending) > 0
+               && SDL_AtomicGet(&queued) == 0 )
+        {
+            SDL_CondWait(wake, lock);
+        }
+
+        SDL_AtomicAdd(&sleeping, -1);
+        SDL_UnlockMutex(lock);
+    }
+
+    SDL_AtomicSet(&group->cancelled, 0);
+}
+
+bool RunPendingTask(void)
+{
+    task_t task;
+
+    if ( TakeTask(&task) ) {
+        Execute(&task);
+        return true;
+    }
+
+    return false;
+}
+
+void CancelTaskGroup(task_group_t * group)
+{
+    SDL_AtomicSet(&group->cancelled, 1);
+}
+
+bool TaskGroupCancelled(task_group_t * group)
+{
+    return SDL_AtomicGet(&group->cancelled);
+}
+
+task_pool_stats_t TaskPoolStats(void)
+{
+    u64 busy_ns = 0;
+    for ( int i = 0; i < num_workers; i++ ) {
+        busy_ns += __atomic_load_n(&workers[i].busy_ns, __ATOMIC_RELAXED);
+    }
+
+    return (task_pool_stats_t){
+        .workers = num_workers,
+        .tasks = SDL_AtomicGet(&num_tasks),
+        .steals = SDL_AtomicGet(&num_steals),
+        .busy_ns = busy_ns,
+    };
+}
@@ -0,0 +1,89 @@
+// -----------------------------------------------------------------------------
+// Task Pool
+//
+// A fixed set of worker threads for running short tasks in parallel. Each
+// worker has its own deque: it runs its newest tasks first, and when it runs
+// out, steals the oldest tasks from the others. Tasks are added to groups,
+// which can be waited on or cancelled.
+//
+//     task_group_t group = { 0 };
+//     for ( int i = 0; i < count; i++ ) {
+//         RunTask(&group, DoThing, &things[i]);
+//     }
+//     WaitTaskGroup(&group);
+//
+// Tasks must not block on each other except through WaitTaskGroup(), which
+// runs other tasks while it waits.
+// -----------------------------------------------------------------------------
+#ifndef __TASKPOOL_H__
+#define __TASKPOOL_H__
+
+#include "genlib.h"
+#include <SDL.h>
+
+#define MAX_TASK_WORKERS 64
+
+typedef void (* task_func_t)(void * data);
+
+/// Called with each tile of a `ParallelForTiles()` area.
+typedef void (* tile_func_t)(SDL_Rect tile, void * data);
+
+// Zero-initialize before use. A group can be reused once waited on.
+typedef struct {
+    SDL_atomic_t pending;   // tasks added and not yet finished
+    SDL_atomic_t cancelled;
+} task_group_t;
+
+typedef struct {
+    int workers;
+    int tasks;  // tasks run, including by waiting threads
+    int steals; // tasks taken from another thread's deque
+    u64 busy_ns; // worker threads' time running tasks, added up
+} task_pool_stats_t;
+
+/// Start the worker threads.
+/// - Parameter num_workers: The number of threads, or 0 for
+///   `DefaultWorkerCount()`.
+void InitTaskPool(int num_workers);
+
+/// Stop the worker threads. All groups should have been waited on. The
+/// pool goes back to how it was before `InitTaskPool()`: tasks added
+/// afterwards run right away on the calling thread.
+void ShutdownTaskPool(void);
+
+/// The number of CPUs this process may actually use: the smaller of its
+/// CPU affinity mask and its cgroup CPU quota, where those are available.
+int DefaultWorkerCount(void);
+
+/// Add a task to a group. If the pool isn't running, the task is run right
+/// away.
+void RunTask(task_group_t * group, task_func_t func, void * data);
+
+/// Split `area` into tiles of at most tile_w by tile_h and add a task to
+/// `group` for each. Call `WaitTaskGroup()` to wait for them.
+void ParallelForTiles
+(   task_group_t * group,
+    SDL_Rect area,
+    int tile_w,
+    int tile_h,
+    tile_func_t func,
+    void * data );
+
+/// Run tasks until all of the group's tasks have finished.
+void WaitTaskGroup(task_group_t * group);
+
+/// Run one waiting task, from any group, on the calling thread. For
+/// threads that wait on something other than a group but can help out
+/// meanwhile.
+/// - Returns: Whether there was a task to run.
+bool RunPendingTask(void);
+
+/// Skip the group's tasks that haven't started. Tasks already running can
+/// check `TaskGroupCancelled()` to stop early. Still wait on the group
+/// afterwards before reusing it or the data its tasks use.
+void CancelTaskGroup(task_group_t * group);
+bool TaskGroupCancelled(task_group_t * group);
+
+task_pool_stats_t TaskPoolStats(void);
+
+#endif /* __TASKPOOL_H__ */
@@ -1,6 +1,9 @@
 #include "text.h"
 
+#include "framebuffer.h"
 #include "genlib.h"
+#include "profiler.h"
+#include "video.h"
 
 #include "fonts/cp437_8x8.h"
 #include "fonts/cp437_8x16.h"
@@ -12,7 +15,8 @@
 typedef struct {
     int width;
     int height;
-    const unsigned char * data;
+    const unsigned char * data; // 256 glyphs, 1 bit per pixel
+    SDL_Texture * atlas; // NULL until the font is first used
 } font_info_t;
 
 static font_info_t info[] = {
@@ -22,7 +26,11 @@ static font_info_t info[] = {
     [FONT_NES_16X16]    = { 16, 16, nes_16x16   },
 };
 
-static SDL_Renderer * renderer; // unowned reference, do not destroy
+#define NUM_FONTS       (int)(sizeof(info) / sizeof(info[0]))
+#define ATLAS_COLUMNS   16 // glyphs per row in a font atlas
+#define ATLAS_ROWS      16
+
+static SDL_Renderer * textRenderer; // unowned reference, do not destroy
 
 // settings for text rendering
 static font_t   font        = FONT_CP437_8X16;
@@ -30,12 +38,188 @@ static float    scaleX      = 1.0f; // horizontal draw scale
 static float    scaleY      = 1.0f; // vertical draw scale
 static int      tabSize     = 4;
 
+// glyph quads for the string being printed
+static SDL_Vertex * vertices;   // 4 per glyph
+static int *        indices;    // 6 per glyph
+static int          numGlyphs;
+static int          maxGlyphs;
+static int          drawCalls;
+
+#pragma mark -
+
+static void DestroyAtlases(void)
+{
+    for ( int i = 0; i < NUM_FONTS; i++ ) {
+        if ( info[i].atlas ) {
+            MemNoteTexture(info[i].atlas, false);
+            SDL_DestroyTexture(info[i].atlas);
+            info[i].atlas = NULL;
+        }
+    }
+}
+
+// Rasterize all of a font's glyphs into a texture, white where the glyph
+// is lit and transparent elsewhere, so it can be tinted with vertex colors.
+static SDL_Texture * FontAtlas(font_t f)
+{
+    if ( info[f].atlas ) {
+        return info[f].atlas;
+    }
+
+    const int w = info[f].width;
+    const int h = info[f].height;
+    const int atlasW = w * ATLAS_COLUMNS;
+    const int atlasH = h * ATLAS_ROWS;
+
+    u32 * pixels = MemCalloc(MEM_TEXT, atlasW * atlasH, sizeof(*pixels));
+    if ( pixels == NULL ) {
+        Error("could not allocate font atlas");
+    }
+
+    const u8 * data = info[f].data;
+    int bit = 7;
+
+    for ( int ch = 0; ch < ATLAS_COLUMNS * ATLAS_ROWS; ch++ ) {
+        int x = (ch % ATLAS_COLUMNS) * w;
+        int y = (ch / ATLAS_COLUMNS) * h;
+
+        for ( int row = 0; row < h; row++ ) {
+            for ( int col = 0; col < w; col++ ) {
+
+                if ( *data & (1 << bit) ) {
+                    pixels[(y + row) * atlasW + x + col] = 0xFFFFFFFF;
+                }
+
+                if ( --bit < 0 ) {
+                    ++data;
+                    bit = 7;
+                }
+            }
+        }
+    }
+
+    SDL_Texture * atlas = SDL_CreateTexture
+    (   textRenderer,
+        SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_STATIC,
+        atlasW,
+        atlasH );
+
+    if ( atlas == NULL ) {
+        Error("could not create font atlas (%s)", SDL_GetError());
+    }
+
+    MemNoteTexture(atlas, true);
+    SDL_UpdateTexture(atlas, NULL, pixels, atlasW * sizeof(*pixels));
+    SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
+    MemFree(pixels);
+
+    info[f].atlas = atlas;
+    return atlas;
+}
+
+// Add a quad for one glyph to the current batch.
+static void AddGlyph(int x, int y, unsigned char character, SDL_Color color)
+{
+    if ( numGlyphs == maxGlyphs ) {
+        maxGlyphs = maxGlyphs ? maxGlyphs * 2 : 128;
+        vertices = MemRealloc(MEM_TEXT, vertices, maxGlyphs * 4 * sizeof(*vertices));
+        indices = MemRealloc(MEM_TEXT, indices, maxGlyphs * 6 * sizeof(*indices));
+
+        if ( vertices == NULL || indices == NULL ) {
+            Error("could not allocate text batch");
+        }
+    }
+
+    const float w = info[font].width * scaleX;
+    const float h = info[font].height * scaleY;
+
+    // atlas coordinates
+    const float u0 = (float)(character % ATLAS_COLUMNS) / ATLAS_COLUMNS;
+    const float v0 = (float)(character / ATLAS_COLUMNS) / ATLAS_ROWS;
+    const float u1 = u0 + 1.0f / ATLAS_COLUMNS;
+    const float v1 = v0 + 1.0f / ATLAS_ROWS;
+
+    SDL_Vertex * v = &vertices[numGlyphs * 4];
+    v[0] = (SDL_Vertex){ { x,     y     }, color, { u0, v0 } };
+    v[1] = (SDL_Vertex){ { x + w, y     }, color, { u1, v0 } };
+    v[2] = (SDL_Vertex){ { x + w, y + h }, color, { u1, v1 } };
+    v[3] = (SDL_Vertex){ { x,     y + h }, color, { u0, v1 } };
+
+    int * i = &indices[numGlyphs * 6];
+    int first = numGlyphs * 4;
+    i[0] = first + 0;
+    i[1] = first + 1;
+    i[2] = first + 2;
+    i[3] = first + 2;
+    i[4] = first + 3;
+    i[5] = first + 0;
+
+    numGlyphs++;
+}
+
+// Draw all glyphs added since the last flush in one go, over anything
+// batched before them.
+static void FlushGlyphs(void)
+{
+    if ( numGlyphs > 0 ) {
+        FlushBatch();
+        drawCalls++;
+        SDL_RenderGeometry
+        (   textRenderer,
+            FontAtlas(font),
+            vertices,
+            numGlyphs * 4,
+            indices,
+            numGlyphs * 6 );
+    }
+
+    numGlyphs = 0;
+}
+
+// With a software framebuffer, glyphs are expanded straight into it from
+// the font bits instead of going through the atlas.
+static bool ToFramebuffer(void)
+{
+    return Framebuffer() != NULL && SDL_GetRenderTarget(textRenderer) == NULL;
+}
+
+static void DrawGlyph(int x, int y, unsigned char character, SDL_Color color)
+{
+    const int w = info[font].width;
+    const int h = info[font].height;
+    const int bytesPerChar = (w * h) / 8;
+    u32 packed = (u32)color.r << 24 | color.g << 16 | color.b << 8 | color.a;
+
+    FlushBatch(); // batched primitives go underneath
+    FramebufferGlyph
+    (   x,
+        y,
+        &info[font].data[character * bytesPerChar],
+        w,
+        h,
+        scaleX,
+        scaleY,
+        packed );
+}
+
+static SDL_Color DrawColor(void)
+{
+    SDL_Color color;
+    SDL_GetRenderDrawColor(textRenderer, &color.r, &color.g, &color.b, &color.a);
+
+    return color;
+}
 
 #pragma mark - PUBLIC FUNCTIONS
 
 void SetTextRenderer(SDL_Renderer * _renderer)
 {
-    renderer = _renderer;
+    if ( _renderer != textRenderer ) {
+        DestroyAtlases(); // they belong to the old renderer
+    }
+
+    textRenderer = _renderer;
 }
 
 void SetFont(font_t _font)
@@ -43,12 +227,23 @@ void SetFont(font_t _font)
     font = _font;
 }
 
+font_t GetFont(void)
+{
+    return font;
+}
+
 void SetTextScale(float x, float y)
 {
     scaleX = x;
     scaleY = y;
 }
 
+void GetTextScale(float * x, float * y)
+{
+    *x = scaleX;
+    *y = scaleY;
+}
+
 void SetTabSize(int size)
 {
     tabSize = size;
@@ -66,62 +261,41 @@ int CharHeight(void)
 
 void PutChar(int x, int y, unsigned char character)
 {
-    if ( renderer == NULL ) {
+    ZONE("PutChar");
+
+    if ( textRenderer == NULL ) {
         Error("no font renderer is set, use SetFontRenderer()");
     }
 
-    // save the current render scale
-    float oldScaleX;
-    float oldScaleY;
-    SDL_RenderGetScale(renderer, &oldScaleX, &oldScaleY);
-
-    SDL_RenderSetScale(renderer, scaleX, scaleY);
-
-    // scale drawing but not coordinates
-    const int unscaledX = (float)x / scaleX;
-    const int unscaledY = (float)y / scaleY;
-
-    const int w = info[font].width;
-    const int h = info[font].height;
-    const int bytesPerChar = (w * h) / 8;
-    const u8 * data = &info[font].data[character * bytesPerChar];
-    int bit = 7;
-
-    for ( int row = 0; row < h; row++ ) {
-        for ( int col = 0; col < w; col++ ) {
-
-            if ( *data & (1 << bit) ) {
-                SDL_RenderDrawPoint(renderer, unscaledX + col, unscaledY + row);
-            }
-
-            if ( --bit < 0 ) {
-                ++data;
-                bit = 7;
-            }
-        }
+    if ( ToFramebuffer() ) {
+        DrawGlyph(x, y, character, DrawColor());
+    } else {
+        AddGlyph(x, y, character, DrawColor());
+        FlushGlyphs();
     }
-
-    // restore previous render scale
-    SDL_RenderSetScale(renderer, oldScaleX, oldScaleY);
 }
 
 void Print(int x, int y, const char * format, ...)
 {
-    va_list args[2];
-    va_start(args[0], format);
-    va_copy(args[1], args[0]);
+    ZONE("Print");
+
+    if ( textRenderer == NULL ) {
+        Error("no font renderer is set, use SetFontRenderer()");
+    }
 
-    int len = vsnprintf(NULL, 0, format, args[0]);
-    char * buffer = calloc(len + 1, sizeof(*buffer));
-    vsnprintf(buffer, len + 1, format, args[1]);
-    va_end(args[0]);
-    va_end(args[1]);
+    arena_mark_t mark = ArenaMark(&frame_arena);
+    va_list args;
+    va_start(args, format);
+    char * buffer = ArenaVPrintf(&frame_arena, format, args);
+    va_end(args);
 
     const char * c = buffer;
     int x1 = x;
     int y1 = y;
     int w = info[font].width * scaleX;
     int h = info[font].height * scaleY;
+    SDL_Color color = DrawColor();
+    bool direct = ToFramebuffer();
 
     while ( *c ) {
         switch ( *c ) {
@@ -134,7 +308,11 @@ void Print(int x, int y, const char * format, ...)
                     ;
                 break;
             default:
-                PutChar(x1, y1, *c);
+                if ( direct ) {
+                    DrawGlyph(x1, y1, *c, color);
+                } else {
+                    AddGlyph(x1, y1, *c, color);
+                }
                 x1 += w;
                 break;
         }
@@ -142,5 +320,11 @@ void Print(int x, int y, const char * format, ...)
         c++;
     }
 
-    free(buffer);
+    FlushGlyphs();
+    ArenaRelease(&frame_arena, mark);
+}
+
+int TextDrawCalls(void)
+{
+    return drawCalls;
 }
@@ -1,7 +1,9 @@
 // -----------------------------------------------------------------------------
 //  Text Library
 //
-//  Rendering of bitmap font text.
+//  Rendering of bitmap font text. Each font is rasterized once into a glyph
+//  atlas texture, and each string is drawn as a single batch of textured
+//  quads (requires SDL 2.0.18 for SDL_RenderGeometry).
 //  TODO: handle sprite sheet fonts?
 // -----------------------------------------------------------------------------
 #ifndef __TEXT_H__
@@ -19,11 +21,14 @@ typedef enum {
 /// Select which renderer to use when rendering text.
 ///
 /// In most cases this should be called once at the
-/// the start of the program.
+/// the start of the program. Font atlases made for a previous renderer are
+/// destroyed.
 void SetTextRenderer(SDL_Renderer * renderer);
 
 void SetFont(font_t font);
+font_t GetFont(void);
 void SetTextScale(float x, float y);
+void GetTextScale(float * x, float * y);
 void SetTabSize(int size);
 
 /// Get the current font character scaled width in pixels.
@@ -41,4 +46,8 @@ void PutChar(int x, int y, unsigned char character);
 ///  The control characters \n and \t are handled as expected.
 void Print(int x, int y, const char * format, ...);
 
+/// The number of SDL calls made to draw text since the program started.
+/// Each `Print()` is one, however many lines it has.
+int TextDrawCalls(void);
+
 #endif /* __TEXT_H__ */
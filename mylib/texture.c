@@ -10,26 +10,22 @@
 #include "video.h"
 #include <dirent.h> // TODO: check if this is portable
 
-#define MAX_TEXTURES    1024
 #define KEY_R           0xFF
 #define KEY_G           0x00
 #define KEY_B           0xFF
 
-typedef struct {
-    char * key;
-    SDL_Texture * texture;
-} texture_t;
-
-int numTextures;
-texture_t textures[MAX_TEXTURES];
+// SDL_Texture by file name
+static hashmap_t textures = { .string_keys = true };
 
 static void CleanupTextures(void)
 {
     puts("clean up textures");
-    for ( int i = 0; i < numTextures; i++ ) {
-        free(textures[i].key);
-        SDL_DestroyTexture(textures[i].texture);
+    for ( map_entry_t * e = NULL; (e = MapNext(&textures, e)); ) {
+        MemNoteTexture(e->value, false);
+        SDL_DestroyTexture(e->value);
     }
+
+    FreeHashMap(&textures);
 }
 
 void LoadTextures(const char * directoryName)
@@ -39,7 +35,6 @@ void LoadTextures(const char * directoryName)
         Error("could not open directory '%s'", directoryName);
     }
 
-    numTextures = 0;
     struct dirent * entry;
     while (( entry = readdir(dir) )) {
         const char * file = entry->d_name;
@@ -48,8 +43,9 @@ void LoadTextures(const char * directoryName)
             continue;
         }
 
-        char * path = calloc
-        (   strlen(directoryName) + strlen(file) + 2,
+        char * path = MemCalloc
+        (   MEM_OTHER,
+            strlen(directoryName) + strlen(file) + 2,
             sizeof(*path) );
 
         strcat(path, directoryName);
@@ -67,22 +63,21 @@ void LoadTextures(const char * directoryName)
         Uint32 key = SDL_MapRGB(surface->format, KEY_R, KEY_G, KEY_B);
         SDL_SetColorKey(surface, SDL_TRUE, key);
 
-        textures[numTextures].key = SDL_strdup(file);
-        textures[numTextures].texture
-            = SDL_CreateTextureFromSurface(renderer, surface);
+        SDL_Texture * texture = SDL_CreateTextureFromSurface(renderer, surface);
 
-        if (textures[numTextures].texture == NULL ) {
+        if ( texture == NULL ) {
             CleanupTextures();
             Error("failed to create texture (%s)\n", file);
         }
 
-        ++numTextures;
-        free(path);
+        MemNoteTexture(texture, true);
+        MapPutString(&textures, file, texture);
+        MemFree(path);
     }
 
     printf
     (   "LoadTextures: loaded %d textures from '%s'\n",
-        numTextures,
+        textures.count,
         directoryName );
 
     atexit(CleanupTextures);
@@ -91,12 +86,11 @@ void LoadTextures(const char * directoryName)
 
 SDL_Texture * GetTexture(const char * name)
 {
-    for ( int i = 0; i < numTextures; i++ ) {
-        if ( strcmp(name, textures[i].key) == 0 ) {
-            return textures[i].texture;
-        }
+    SDL_Texture * texture = MapGetString(&textures, name);
+
+    if ( texture == NULL ) {
+        Error("texture '%s' not found", name);
     }
 
-    Error("texture '%s' not found", name);
-    return NULL;
+    return texture;
 }
@@ -0,0 +1,135 @@
+#include "timing.h"
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define CALIBRATION_NS (20 * NS_PER_MS)
+
+// With the TSC, a time is base_ns + (tsc - base_tsc) * ns_per_tick, where
+// ns_per_tick is a 32.32 fixed point number.
+static bool use_tsc;
+static u64 base_ns;
+static u64 base_tsc;
+static u64 ns_per_tick;
+
+static u64 start_ns;
+static _Thread_local int timer_depth;
+
+static u64 MonotonicNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64)ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+#ifdef HAVE_TSC
+// The TSC is only usable as a clock if it ticks at a constant rate
+// through frequency changes and sleep states.
+static bool InvariantTSC(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if ( __get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0
+        || eax < 0x80000007 )
+    {
+        return false;
+    }
+
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+
+    return edx & (1 << 8);
+}
+
+static void CalibrateTSC(void)
+{
+    u64 ns0 = MonotonicNow();
+    u64 tsc0 = __rdtsc();
+
+    u64 ns1;
+    do {
+        ns1 = MonotonicNow();
+    } while ( ns1 - ns0 < CALIBRATION_NS );
+    u64 tsc1 = __rdtsc();
+
+    if ( tsc1 <= tsc0 ) {
+        return;
+    }
+
+    ns_per_tick = ((ns1 - ns0) << 32) / (tsc1 - tsc0);
+    base_ns = ns1;
+    base_tsc = tsc1;
+    use_tsc = ns_per_tick > 0;
+}
+#endif
+
+#pragma mark - PUBLIC FUNCTIONS
+
+void InitTiming(bool tsc)
+{
+#ifdef HAVE_TSC
+    if ( tsc && InvariantTSC() ) {
+        CalibrateTSC();
+    }
+#else
+    (void)tsc;
+#endif
+
+    start_ns = Now();
+}
+
+bool TimingUsesTSC(void)
+{
+    return use_tsc;
+}
+
+u64 Now(void)
+{
+#ifdef HAVE_TSC
+    if ( use_tsc ) {
+        u64 ticks = __rdtsc() - base_tsc;
+        return base_ns + (u64)(((unsigned __int128)ticks * ns_per_tick) >> 32);
+    }
+#endif
+
+    return MonotonicNow();
+}
+
+u64 TimeSinceStart(void)
+{
+    u64 now = Now();
+    u64 start = 0;
+
+    // the first caller sets it, if InitTiming() didn't
+    if ( !__atomic_compare_exchange_n(&start_ns, &start, now, false,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+    {
+        return now - start;
+    }
+
+    return 0;
+}
+
+scoped_timer_t BeginScopedTimer(const char * name)
+{
+    timer_depth++;
+
+    return (scoped_timer_t){ name, Now() };
+}
+
+void EndScopedTimer(scoped_timer_t * timer)
+{
+    u64 ns = Now() - timer->start;
+    timer_depth--;
+
+    printf("%*s%s took %.3f ms\n", timer_depth * 2, "", timer->name, NsToMs(ns));
+}
+
+extern inline double NsToMs(u64 ns);
+extern inline double NsToUs(u64 ns);
+extern inline double MsSince(u64 start);
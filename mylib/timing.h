@@ -0,0 +1,81 @@
+// -----------------------------------------------------------------------------
+// Timing
+//
+// Monotonic timestamps in nanoseconds, for measuring things that take well
+// under a millisecond. They come from CLOCK_MONOTONIC, or, after
+// `InitTiming(true)` on a CPU with an invariant timestamp counter, from
+// rdtsc, which is much cheaper to read. Its rate is measured against
+// CLOCK_MONOTONIC, so the two drift apart by up to about 0.01%: fine for
+// timing things, not for telling the time.
+//
+// Scoped timers print how long a block took when it's left, and can be
+// nested and used any number of times per function:
+//
+//     void LoadLevel(void)
+//     {
+//         TIME_SCOPE("load level");
+//         {
+//             TIME_SCOPE("textures");
+//             ...
+//         }
+//         ...
+//     }
+// -----------------------------------------------------------------------------
+#ifndef __TIMING_H__
+#define __TIMING_H__
+
+#include "genlib.h"
+
+#define NS_PER_SEC  1000000000ull
+#define NS_PER_MS   1000000ull
+#define NS_PER_US   1000ull
+
+typedef struct {
+    const char * name;
+    u64 start;
+} scoped_timer_t;
+
+#define TIMER_NAME2(n) _scoped_timer_##n
+#define TIMER_NAME(n) TIMER_NAME2(n)
+
+/// Print how long the rest of the enclosing block takes, indented by how
+/// many scoped timers the thread is inside of.
+#define TIME_SCOPE(name) \
+    scoped_timer_t TIMER_NAME(__COUNTER__) \
+    __attribute__((cleanup(EndScopedTimer))) = BeginScopedTimer(name)
+
+/// Set up the clock. Without calling this, `Now()` uses CLOCK_MONOTONIC.
+/// - Parameter use_tsc: Measure the timestamp counter against
+///   CLOCK_MONOTONIC (for about 20 ms) and use it if it's invariant.
+void InitTiming(bool use_tsc);
+
+/// Whether `Now()` reads the timestamp counter.
+bool TimingUsesTSC(void);
+
+/// Nanoseconds since some fixed point in the past.
+u64 Now(void);
+
+/// Nanoseconds since `InitTiming()`, or since the first call if it wasn't
+/// called.
+u64 TimeSinceStart(void);
+
+inline double NsToMs(u64 ns)
+{
+    return ns / (double)NS_PER_MS;
+}
+
+inline double NsToUs(u64 ns)
+{
+    return ns / (double)NS_PER_US;
+}
+
+/// Milliseconds between `start` (a `Now()` time) and now.
+inline double MsSince(u64 start)
+{
+    return NsToMs(Now() - start);
+}
+
+scoped_timer_t BeginScopedTimer(const char * name);
+void EndScopedTimer(scoped_timer_t * timer);
+
+#endif /* __TIMING_H__ */
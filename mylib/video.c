@@ -1,11 +1,16 @@
 #include "video.h"
 
 static SDL_Window * window;
+static SDL_Renderer * window_renderer; // same as `renderer` unless software
 SDL_Renderer * renderer;
+bool software_backend;
+u64 texture_draws;
 
 static void CleanUp(void)
 {
-    SDL_DestroyRenderer(renderer);
+    ClearTexturePool();
+    ShutdownFramebuffer(); // destroys the software renderer
+    SDL_DestroyRenderer(window_renderer);
     SDL_DestroyWindow(window);
     SDL_QuitSubSystem(SDL_INIT_VIDEO);
 }
@@ -31,12 +36,19 @@ void InitWindow(window_info_t info) {
         Error("could not create window: %s", SDL_GetError());
     }
 
-    renderer = SDL_CreateRenderer(window, -1, info.render.flags);
+    window_renderer = SDL_CreateRenderer(window, -1, info.render.flags);
 
-    if ( renderer == NULL ) {
+    if ( window_renderer == NULL ) {
         Error("could not create renderer: %s", SDL_GetError());
     }
 
+    if ( info.backend == BACKEND_SOFTWARE ) {
+        renderer = InitFramebuffer(window, window_renderer);
+        software_backend = true;
+    } else {
+        renderer = window_renderer;
+    }
+
     if ( info.render.logicalWidth && info.render.logicalHeight ) {
         SDL_RenderSetLogicalSize
         (   renderer,
@@ -118,10 +130,22 @@ void DrawCircle (int x0, int y0, int radius)
     int x = 0;
     int y = radius;
 
-    SDL_RenderDrawPoint(renderer, x0, y0 + radius);
-    SDL_RenderDrawPoint(renderer, x0, y0 - radius);
-    SDL_RenderDrawPoint(renderer, x0 + radius, y0);
-    SDL_RenderDrawPoint(renderer, x0 - radius, y0);
+    // 8 points per step, at most radius steps
+    SDL_Point stack_points[256];
+    int max_points = 4 + 8 * (radius > 0 ? radius : 0);
+    SDL_Point * points = stack_points;
+    if ( max_points > 256 ) {
+        points = MemAlloc(MEM_VIDEO, max_points * sizeof(*points));
+        if ( points == NULL ) {
+            Error("out of memory");
+        }
+    }
+
+    int n = 0;
+    points[n++] = (SDL_Point){ x0, y0 + radius };
+    points[n++] = (SDL_Point){ x0, y0 - radius };
+    points[n++] = (SDL_Point){ x0 + radius, y0 };
+    points[n++] = (SDL_Point){ x0 - radius, y0 };
 
     while ( x < y ) {
 
@@ -135,32 +159,744 @@ void DrawCircle (int x0, int y0, int radius)
         ddF_x += 2;
         f += ddF_x + 1;
 
-        SDL_RenderDrawPoint(renderer, x0 + x, y0 + y);
-        SDL_RenderDrawPoint(renderer, x0 - x, y0 + y);
-        SDL_RenderDrawPoint(renderer, x0 + x, y0 - y);
-        SDL_RenderDrawPoint(renderer, x0 - x, y0 - y);
-        SDL_RenderDrawPoint(renderer, x0 + y, y0 + x);
-        SDL_RenderDrawPoint(renderer, x0 - y, y0 + x);
-        SDL_RenderDrawPoint(renderer, x0 + y, y0 - x);
-        SDL_RenderDrawPoint(renderer, x0 - y, y0 - x);
+        points[n++] = (SDL_Point){ x0 + x, y0 + y };
+        points[n++] = (SDL_Point){ x0 - x, y0 + y };
+        points[n++] = (SDL_Point){ x0 + x, y0 - y };
+        points[n++] = (SDL_Point){ x0 - x, y0 - y };
+        points[n++] = (SDL_Point){ x0 + y, y0 + x };
+        points[n++] = (SDL_Point){ x0 - y, y0 + x };
+        points[n++] = (SDL_Point){ x0 + y, y0 - x };
+        points[n++] = (SDL_Point){ x0 - y, y0 - x };
+    }
+
+    if ( batch_mode || software_backend ) {
+        BatchPoints(points, n);
+    } else {
+        SDL_RenderDrawPoints(renderer, points, n);
+    }
+
+    if ( points != stack_points ) {
+        MemFree(points);
     }
 }
 
-SDL_Texture * CreateTexture(int w, int h)
+#pragma mark - SOFTWARE BACKEND
+
+// Whether to draw straight into the framebuffer. When the render target is
+// a texture, drawing goes through the software renderer instead.
+static bool ToFramebuffer(void)
+{
+    return software_backend && SDL_GetRenderTarget(renderer) == NULL;
+}
+
+static u32 PackColor(SDL_Color c)
 {
-    SDL_Texture * texture = SDL_CreateTexture
+    return (u32)c.r << 24 | c.g << 16 | c.b << 8 | c.a;
+}
+
+static bool DrawBlending(void)
+{
+    SDL_BlendMode mode;
+    SDL_GetRenderDrawBlendMode(renderer, &mode);
+
+    return mode == SDL_BLENDMODE_BLEND;
+}
+
+static void SoftwareRect(SDL_Rect r, SDL_Color color, bool filled, bool blend)
+{
+    u32 c = PackColor(color);
+
+    if ( filled ) {
+        FramebufferFill(r, c, blend);
+    } else if ( r.w > 0 && r.h > 0 ) {
+        FramebufferFill((SDL_Rect){ r.x, r.y, r.w, 1 }, c, blend);
+        FramebufferFill((SDL_Rect){ r.x, r.y + r.h - 1, r.w, 1 }, c, blend);
+        FramebufferFill((SDL_Rect){ r.x, r.y + 1, 1, r.h - 2 }, c, blend);
+        FramebufferFill((SDL_Rect){ r.x + r.w - 1, r.y + 1, 1, r.h - 2 }, c, blend);
+    }
+}
+
+void ClearSoftware(void)
+{
+    if ( ToFramebuffer() ) {
+        SDL_Color c;
+        SDL_GetRenderDrawColor(renderer, &c.r, &c.g, &c.b, &c.a);
+        FramebufferFill(Framebuffer()->clip, PackColor(c), false);
+    } else {
+        SDL_RenderClear(renderer);
+    }
+}
+
+// Streaming textures made by the software renderer can be locked to get at
+// their pixels without a copy, so they're blitted directly. Other textures
+// are left to SDL.
+void DrawTextureSoftware
+(   SDL_Texture * texture,
+    const SDL_Rect * src,
+    const SDL_Rect * dst )
+{
+    u32 format;
+    int access, w, h;
+    SDL_QueryTexture(texture, &format, &access, &w, &h);
+
+    void * pixels;
+    int pitch;
+
+    if ( !ToFramebuffer()
+        || access != SDL_TEXTUREACCESS_STREAMING
+        || format != SDL_PIXELFORMAT_RGBA8888
+        || SDL_LockTexture(texture, NULL, &pixels, &pitch) != 0 )
+    {
+        SDL_RenderCopy(renderer, texture, src, dst);
+        return;
+    }
+
+    SDL_BlendMode mode;
+    SDL_GetTextureBlendMode(texture, &mode);
+
+    FramebufferBlit
+    (   pixels,
+        pitch / sizeof(u32),
+        w,
+        h,
+        src,
+        dst,
+        mode == SDL_BLENDMODE_BLEND );
+
+    SDL_UnlockTexture(texture);
+}
+
+#pragma mark - BATCHING
+
+typedef enum {
+    COMMAND_POINT,
+    COMMAND_RECT,
+    COMMAND_FILL_RECT,
+} command_type_t;
+
+typedef struct {
+    command_type_t type;
+    SDL_Color color;
+    int order; // recording order, to keep sorting stable
+    union {
+        SDL_Point point;
+        SDL_Rect rect;
+    };
+} draw_command_t;
+
+batch_mode_t batch_mode;
+static batch_stats_t batch_stats;
+
+static draw_command_t * commands;
+static int num_commands;
+static int max_commands;
+
+// scratch buffers for one run of commands
+static SDL_Point * run_points;
+static SDL_Rect * run_rects;
+static SDL_Vertex * run_vertices;
+static int * run_indices;
+static int max_run;
+
+static void ReserveRun(int count)
+{
+    if ( count <= max_run ) {
+        return;
+    }
+
+    max_run = count > max_run * 2 ? count : max_run * 2;
+    run_points = MemRealloc(MEM_VIDEO, run_points, max_run * sizeof(*run_points));
+    run_rects = MemRealloc(MEM_VIDEO, run_rects, max_run * sizeof(*run_rects));
+    run_vertices = MemRealloc(MEM_VIDEO, run_vertices, max_run * 4 * sizeof(*run_vertices));
+    run_indices = MemRealloc(MEM_VIDEO, run_indices, max_run * 6 * sizeof(*run_indices));
+
+    if ( !run_points || !run_rects || !run_vertices || !run_indices ) {
+        Error("out of memory");
+    }
+}
+
+static draw_command_t * NewCommand(command_type_t type)
+{
+    if ( num_commands == max_commands ) {
+        max_commands = max_commands ? max_commands * 2 : 256;
+        commands = MemRealloc(MEM_VIDEO, commands, max_commands * sizeof(*commands));
+        if ( commands == NULL ) {
+            Error("out of memory");
+        }
+    }
+
+    draw_command_t * command = &commands[num_commands];
+    command->type = type;
+    command->order = num_commands++;
+    SDL_GetRenderDrawColor
     (   renderer,
-        SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET,
-        w, h );
+        &command->color.r,
+        &command->color.g,
+        &command->color.b,
+        &command->color.a );
+
+    batch_stats.commands++;
+    return command;
+}
+
+static bool SameColor(SDL_Color a, SDL_Color b)
+{
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+// Whether b can be drawn in the same SDL call as a. Filled rects are drawn
+// as geometry with vertex colors, so they don't need to match in color.
+static bool SameRun(const draw_command_t * a, const draw_command_t * b)
+{
+    return a->type == b->type
+        && (a->type == COMMAND_FILL_RECT || SameColor(a->color, b->color));
+}
+
+static int CompareCommands(const void * a, const void * b)
+{
+    const draw_command_t * c1 = a;
+    const draw_command_t * c2 = b;
+
+    if ( c1->type != c2->type ) {
+        return c1->type - c2->type;
+    }
+
+    u32 color1;
+    u32 color2;
+    memcpy(&color1, &c1->color, sizeof(color1));
+    memcpy(&color2, &c2->color, sizeof(color2));
+    if ( color1 != color2 ) {
+        return color1 < color2 ? -1 : 1;
+    }
+
+    return c1->order - c2->order;
+}
+
+// Draw `count` commands that are all in the same run. A run counts as one
+// draw call with either backend.
+static void DrawRun(const draw_command_t * run, int count)
+{
+    batch_stats.draw_calls++;
+    ReserveRun(count);
+
+    if ( ToFramebuffer() ) {
+        bool blend = DrawBlending();
+
+        if ( run->type == COMMAND_POINT ) {
+            // points in a run are all the same color
+            for ( int i = 0; i < count; i++ ) {
+                run_points[i] = run[i].point;
+            }
+            FramebufferPoints(run_points, count, PackColor(run->color), blend);
+        } else {
+            for ( int i = 0; i < count; i++ ) {
+                SoftwareRect
+                (   run[i].rect,
+                    run[i].color,
+                    run[i].type == COMMAND_FILL_RECT,
+                    blend );
+            }
+        }
+        return;
+    }
+
+    SDL_Color c = run->color;
+    SDL_SetRenderDrawColor(renderer, c.r, c.g, c.b, c.a);
+
+    switch ( run->type ) {
+        case COMMAND_POINT:
+            for ( int i = 0; i < count; i++ ) {
+                run_points[i] = run[i].point;
+            }
+            SDL_RenderDrawPoints(renderer, run_points, count);
+            break;
+        case COMMAND_RECT:
+            for ( int i = 0; i < count; i++ ) {
+                run_rects[i] = run[i].rect;
+            }
+            SDL_RenderDrawRects(renderer, run_rects, count);
+            break;
+        case COMMAND_FILL_RECT:
+            for ( int i = 0; i < count; i++ ) {
+                SDL_Rect r = run[i].rect;
+                SDL_Vertex * v = &run_vertices[i * 4];
+                SDL_Color color = run[i].color;
+                v[0] = (SDL_Vertex){ { r.x,       r.y       }, color, { 0, 0 } };
+                v[1] = (SDL_Vertex){ { r.x + r.w, r.y       }, color, { 0, 0 } };
+                v[2] = (SDL_Vertex){ { r.x + r.w, r.y + r.h }, color, { 0, 0 } };
+                v[3] = (SDL_Vertex){ { r.x,       r.y + r.h }, color, { 0, 0 } };
+
+                int * index = &run_indices[i * 6];
+                index[0] = i * 4 + 0;
+                index[1] = i * 4 + 1;
+                index[2] = i * 4 + 2;
+                index[3] = i * 4 + 2;
+                index[4] = i * 4 + 3;
+                index[5] = i * 4 + 0;
+            }
+            SDL_RenderGeometry
+            (   renderer,
+                NULL,
+                run_vertices,
+                count * 4,
+                run_indices,
+                count * 6 );
+            break;
+    }
+}
+
+void SetBatchMode(batch_mode_t mode)
+{
+    FlushBatch();
+    batch_mode = mode;
+}
+
+void FlushBatch(void)
+{
+    if ( num_commands == 0 ) {
+        return;
+    }
+
+    SDL_Color saved;
+    SDL_GetRenderDrawColor(renderer, &saved.r, &saved.g, &saved.b, &saved.a);
+
+    if ( batch_mode == BATCH_SORTED ) {
+        qsort(commands, num_commands, sizeof(*commands), CompareCommands);
+    }
+
+    int first = 0;
+    for ( int i = 1; i <= num_commands; i++ ) {
+        if ( i == num_commands || !SameRun(&commands[first], &commands[i]) ) {
+            DrawRun(&commands[first], i - first);
+            first = i;
+        }
+    }
+
+    num_commands = 0;
+    SDL_SetRenderDrawColor(renderer, saved.r, saved.g, saved.b, saved.a);
+}
+
+batch_stats_t BatchStats(void)
+{
+    batch_stats_t stats = batch_stats;
+    stats.texture_draws = texture_draws;
+
+    return stats;
+}
+
+void BatchPoints(const SDL_Point * points, int count)
+{
+    if ( batch_mode ) {
+        for ( int i = 0; i < count; i++ ) {
+            NewCommand(COMMAND_POINT)->point = points[i];
+        }
+    } else if ( ToFramebuffer() ) {
+        SDL_Color c;
+        SDL_GetRenderDrawColor(renderer, &c.r, &c.g, &c.b, &c.a);
+        FramebufferPoints(points, count, PackColor(c), DrawBlending());
+    } else {
+        SDL_RenderDrawPoints(renderer, points, count);
+    }
+}
+
+void BatchRect(SDL_Rect rect, bool filled)
+{
+    if ( batch_mode ) {
+        NewCommand(filled ? COMMAND_FILL_RECT : COMMAND_RECT)->rect = rect;
+    } else if ( ToFramebuffer() ) {
+        SDL_Color c;
+        SDL_GetRenderDrawColor(renderer, &c.r, &c.g, &c.b, &c.a);
+        SoftwareRect(rect, c, filled, DrawBlending());
+    } else if ( filled ) {
+        SDL_RenderFillRect(renderer, &rect);
+    } else {
+        SDL_RenderDrawRect(renderer, &rect);
+    }
+}
+
+#pragma mark - TEXTURE POOL
+
+// Idle textures are kept in one list per size class, most recently
+// released first, so a lookup only looks at textures of about the right
+// size. Reuse is exact, though: callers rely on a texture being the size
+// they asked for.
+
+#define NUM_SIZE_CLASSES 32 // by log2 of texture bytes
+
+typedef struct pooled_texture {
+    SDL_Texture * texture;
+    u32 format;
+    int access;
+    int w;
+    int h;
+    u32 released; // release_count when it was released
+    struct pooled_texture * prev; // more recently released
+    struct pooled_texture * next; // less recently released
+} pooled_texture_t;
+
+static pooled_texture_t * pool_heads[NUM_SIZE_CLASSES];
+static pooled_texture_t * pool_tails[NUM_SIZE_CLASSES];
+static pooled_texture_t * free_entries; // linked by `next`, for reuse
+static u32 release_count;
+static texture_pool_stats_t pool_stats = {
+    .budget = DEFAULT_TEXTURE_POOL_BUDGET
+};
+
+static size_t TextureBytes(u32 format, int w, int h)
+{
+    return (size_t)w * h * SDL_BYTESPERPIXEL(format);
+}
+
+static int SizeClass(size_t bytes)
+{
+    int size_class = 0;
+
+    while ( bytes > 1 && size_class < NUM_SIZE_CLASSES - 1 ) {
+        bytes >>= 1;
+        size_class++;
+    }
+
+    return size_class;
+}
+
+// Entries are recycled, so releasing and reacquiring textures frame after
+// frame doesn't touch the heap.
+static pooled_texture_t * NewEntry(void)
+{
+    pooled_texture_t * entry = free_entries;
+
+    if ( entry ) {
+        free_entries = entry->next;
+        return entry;
+    }
+
+    return MemAlloc(MEM_VIDEO, sizeof(*entry));
+}
+
+static void FreeEntry(pooled_texture_t * entry)
+{
+    entry->next = free_entries;
+    free_entries = entry;
+}
+
+static void PoolUnlink(pooled_texture_t * entry)
+{
+    int size_class = SizeClass(TextureBytes(entry->format, entry->w, entry->h));
+
+    if ( entry->prev ) {
+        entry->prev->next = entry->next;
+    } else {
+        pool_heads[size_class] = entry->next;
+    }
+
+    if ( entry->next ) {
+        entry->next->prev = entry->prev;
+    } else {
+        pool_tails[size_class] = entry->prev;
+    }
+
+    pool_stats.idle--;
+    pool_stats.bytes -= TextureBytes(entry->format, entry->w, entry->h);
+}
+
+// Destroy the least recently released textures until under budget.
+static void PoolEvict(void)
+{
+    while ( pool_stats.bytes > pool_stats.budget ) {
+        pooled_texture_t * oldest = NULL;
+
+        for ( int i = 0; i < NUM_SIZE_CLASSES; i++ ) {
+            pooled_texture_t * tail = pool_tails[i];
+            if ( tail && (oldest == NULL || tail->released < oldest->released) ) {
+                oldest = tail;
+            }
+        }
+
+        PoolUnlink(oldest);
+        MemNoteTexture(oldest->texture, false);
+        SDL_DestroyTexture(oldest->texture);
+        FreeEntry(oldest);
+    }
+}
+
+SDL_Texture * AcquireTexture(u32 format, int access, int w, int h)
+{
+    int size_class = SizeClass(TextureBytes(format, w, h));
+
+    for ( pooled_texture_t * e = pool_heads[size_class]; e; e = e->next ) {
+        if ( e->format == format && e->access == access
+            && e->w == w && e->h == h )
+        {
+            SDL_Texture * texture = e->texture;
+            PoolUnlink(e);
+            FreeEntry(e);
+
+            pool_stats.hits++;
+            pool_stats.in_use++;
+            pool_stats.in_use_bytes += TextureBytes(format, w, h);
+            return texture;
+        }
+    }
+
+    SDL_Texture * texture = SDL_CreateTexture(renderer, format, access, w, h);
 
     if ( texture == NULL ) {
-        Error("could not create texture (%s)\n", SDL_GetError());
+        Error("could not create texture (%s)", SDL_GetError());
     }
 
+    MemNoteTexture(texture, true);
+    pool_stats.misses++;
+    pool_stats.in_use++;
+    pool_stats.in_use_bytes += TextureBytes(format, w, h);
     return texture;
 }
 
+void ReleaseTexture(SDL_Texture * texture)
+{
+    if ( texture == NULL ) {
+        return;
+    }
+
+    u32 format;
+    int access, w, h;
+    SDL_QueryTexture(texture, &format, &access, &w, &h);
+    size_t bytes = TextureBytes(format, w, h);
+
+    pool_stats.in_use--;
+    pool_stats.in_use_bytes -= bytes;
+
+    pooled_texture_t * entry = NewEntry();
+    if ( entry == NULL ) {
+        MemNoteTexture(texture, false);
+        SDL_DestroyTexture(texture);
+        return;
+    }
+
+    entry->texture = texture;
+    entry->released = release_count++;
+    entry->format = format;
+    entry->access = access;
+    entry->w = w;
+    entry->h = h;
+
+    if ( bytes > pool_stats.budget ) {
+        MemNoteTexture(texture, false);
+        SDL_DestroyTexture(texture);
+        FreeEntry(entry);
+        return;
+    }
+
+    int size_class = SizeClass(bytes);
+    entry->prev = NULL;
+    entry->next = pool_heads[size_class];
+
+    if ( pool_heads[size_class] ) {
+        pool_heads[size_class]->prev = entry;
+    } else {
+        pool_tails[size_class] = entry;
+    }
+
+    pool_heads[size_class] = entry;
+    pool_stats.idle++;
+    pool_stats.bytes += bytes;
+
+    PoolEvict();
+}
+
+void SetTexturePoolBudget(size_t bytes)
+{
+    pool_stats.budget = bytes;
+    PoolEvict();
+}
+
+void ClearTexturePool(void)
+{
+    size_t budget = pool_stats.budget;
+    SetTexturePoolBudget(0);
+    pool_stats.budget = budget;
+
+    while ( free_entries ) {
+        pooled_texture_t * next = free_entries->next;
+        MemFree(free_entries);
+        free_entries = next;
+    }
+}
+
+SDL_Texture * CreateTexture(int w, int h)
+{
+    return AcquireTexture
+    (   SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_TARGET,
+        w, h );
+}
+
+texture_pool_stats_t TexturePoolStats(void)
+{
+    return pool_stats;
+}
+
+#pragma mark - PALETTE EXPANSION
+
+static void ExpandPalette_C
+(   const u8 * indices,
+    u32 * colors,
+    int count,
+    const u32 palette[16] )
+{
+    for ( int i = 0; i < count; i++ ) {
+        colors[i] = indices[i] & 0x80 ? 0 : palette[indices[i] & 0x0F];
+    }
+}
+
+// Split the palette into four 16-byte tables, one per byte of the color as
+// laid out in memory, so each can be looked up with a byte shuffle.
+static void PaletteTables(const u32 palette[16], u8 tables[4][16])
+{
+    for ( int i = 0; i < 16; i++ ) {
+        const u8 * bytes = (const u8 *)&palette[i];
+        for ( int b = 0; b < 4; b++ ) {
+            tables[b][i] = bytes[b];
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// pshufb gives 0 for indices with the high bit set, which is just what
+// ExpandPalette() promises.
+__attribute__((target("ssse3")))
+static void ExpandPalette_SSSE3
+(   const u8 * indices,
+    u32 * colors,
+    int count,
+    const u32 palette[16] )
+{
+    u8 tables[4][16];
+    PaletteTables(palette, tables);
+
+    __m128i t0 = _mm_loadu_si128((const __m128i *)tables[0]);
+    __m128i t1 = _mm_loadu_si128((const __m128i *)tables[1]);
+    __m128i t2 = _mm_loadu_si128((const __m128i *)tables[2]);
+    __m128i t3 = _mm_loadu_si128((const __m128i *)tables[3]);
+
+    int i = 0;
+    for ( ; i + 16 <= count; i += 16 ) {
+        __m128i v = _mm_loadu_si128((const __m128i *)&indices[i]);
+        __m128i b0 = _mm_shuffle_epi8(t0, v);
+        __m128i b1 = _mm_shuffle_epi8(t1, v);
+        __m128i b2 = _mm_shuffle_epi8(t2, v);
+        __m128i b3 = _mm_shuffle_epi8(t3, v);
+
+        __m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+        __m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+        __m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+        __m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+
+        __m128i * out = (__m128i *)&colors[i];
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(lo01, lo23));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo01, lo23));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi01, hi23));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi01, hi23));
+    }
+
+    ExpandPalette_C(&indices[i], &colors[i], count - i, palette);
+}
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+
+// tbl gives 0 for any index past the end of the table. Masking with 0x8F
+// keeps that for indices with the high bit set, and makes 16...127 wrap
+// around like they do with pshufb and in C.
+static void ExpandPalette_NEON
+(   const u8 * indices,
+    u32 * colors,
+    int count,
+    const u32 palette[16] )
+{
+    u8 tables[4][16];
+    PaletteTables(palette, tables);
+
+    uint8x16_t t0 = vld1q_u8(tables[0]);
+    uint8x16_t t1 = vld1q_u8(tables[1]);
+    uint8x16_t t2 = vld1q_u8(tables[2]);
+    uint8x16_t t3 = vld1q_u8(tables[3]);
+    uint8x16_t mask = vdupq_n_u8(0x8F);
+
+    int i = 0;
+    for ( ; i + 16 <= count; i += 16 ) {
+        uint8x16_t v = vandq_u8(vld1q_u8(&indices[i]), mask);
+        uint8x16x4_t out = {{
+            vqtbl1q_u8(t0, v),
+            vqtbl1q_u8(t1, v),
+            vqtbl1q_u8(t2, v),
+            vqtbl1q_u8(t3, v),
+        }};
+        vst4q_u8((u8 *)&colors[i], out);
+    }
+
+    ExpandPalette_C(&indices[i], &colors[i], count - i, palette);
+}
+#endif
+
+void ExpandPalette
+(   const u8 * indices,
+    u32 * colors,
+    int count,
+    const u32 palette[16] )
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static int has_ssse3 = -1;
+    if ( has_ssse3 == -1 ) {
+        has_ssse3 = SDL_HasSSSE3();
+    }
+
+    if ( has_ssse3 ) {
+        ExpandPalette_SSSE3(indices, colors, count, palette);
+        return;
+    }
+#elif defined(__aarch64__)
+    ExpandPalette_NEON(indices, colors, count, palette);
+    return;
+#endif
+
+    ExpandPalette_C(indices, colors, count, palette);
+}
+
+void UpdateTextureIndexed
+(   SDL_Texture * texture,
+    const SDL_Rect * rect,
+    const u8 * indices,
+    int pitch,
+    const u32 palette[16] )
+{
+    ZONE("UpdateTextureIndexed");
+
+    int w, h;
+    if ( rect ) {
+        w = rect->w;
+        h = rect->h;
+    } else {
+        SDL_QueryTexture(texture, NULL, NULL, &w, &h);
+    }
+
+    void * pixels;
+    int texture_pitch;
+    if ( SDL_LockTexture(texture, rect, &pixels, &texture_pitch) != 0 ) {
+        Error("could not lock texture (%s)", SDL_GetError());
+    }
+
+    for ( int y = 0; y < h; y++ ) {
+        ExpandPalette
+        (   indices + y * pitch,
+            (u32 *)((u8 *)pixels + y * texture_pitch),
+            w,
+            palette );
+    }
+
+    SDL_UnlockTexture(texture);
+}
+
 extern inline void Clear(void);
 extern inline void Present(void);
 extern inline void DrawRect(SDL_Rect rect);
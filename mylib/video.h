@@ -6,9 +6,16 @@
 #ifndef __VIDEO_H__
 #define __VIDEO_H__
 
+#include "framebuffer.h"
 #include "genlib.h"
+#include "profiler.h"
 #include <SDL.h>
 
+typedef enum {
+    BACKEND_SDL,            // draw with the SDL renderer
+    BACKEND_SOFTWARE,       // draw into a CPU framebuffer, see framebuffer.h
+} video_backend_t;
+
 typedef struct {            // default value / set?
     const char * title;     // ""
     int x;                  // SDL_WINDOWPOS_CENTERED
@@ -16,6 +23,7 @@ typedef struct {            // default value / set?
     int width;              // 640
     int height;             // 480
     int flags;              // 0
+    video_backend_t backend;// BACKEND_SDL
 
     // TODO: some of this is in progress...
     struct {
@@ -37,7 +45,22 @@ typedef enum {
     DESKTOP = SDL_WINDOW_FULLSCREEN_DESKTOP,
 } fullscreen_t;
 
+typedef enum {
+    BATCH_OFF,      // draw primitives immediately (default)
+    BATCH_ORDERED,  // defer primitives and merge runs, keeping draw order
+    BATCH_SORTED,   // also group by type and color; for non-overlapping ones
+} batch_mode_t;
+
+typedef struct {
+    u64 commands;   // primitives recorded
+    u64 draw_calls; // SDL calls made to draw them (runs, if software)
+    u64 texture_draws; // DrawTexture() calls, which aren't batched
+} batch_stats_t;    // draw calls saved = commands - draw_calls
+
 extern SDL_Renderer * renderer;
+extern batch_mode_t batch_mode;
+extern bool software_backend;
+extern u64 texture_draws; // see BatchStats()
 
 /// Initialize window and renderer with options specified in `info`.
 /// - Parameter info: Zero values signal to use default values or to not set.
@@ -52,34 +75,82 @@ void ToggleFullscreen(fullscreen_t mode);
 
 void DrawCircle (int x0, int y0, int radius);
 
+/// Turn batching of points, rects, and circles on or off. While batching,
+/// they're recorded with the current draw color and drawn with as few SDL
+/// calls as possible by `FlushBatch()`, which is called automatically by
+/// `Clear()`, `Present()`, `DrawTexture()`, and text drawing (text.h).
+/// Call it yourself before drawing with SDL directly or changing the
+/// render target.
+void SetBatchMode(batch_mode_t mode);
+
+/// Draw all recorded primitives.
+void FlushBatch(void);
+
+/// Totals since the program started.
+batch_stats_t BatchStats(void);
+
+/// Record points or a rect in the current draw color (see `SetBatchMode()`),
+/// or draw them now if batching is off.
+void BatchPoints(const SDL_Point * points, int count);
+void BatchRect(SDL_Rect rect, bool filled);
+
+// software backend versions of the functions below
+void ClearSoftware(void);
+void DrawTextureSoftware(SDL_Texture * texture, const SDL_Rect * src, const SDL_Rect * dst);
+
 /// Clear the rendering target with current draw color.
 inline void Clear(void)
 {
-    SDL_RenderClear(renderer);
+    FlushBatch();
+
+    if ( software_backend ) {
+        ClearSoftware();
+    } else {
+        SDL_RenderClear(renderer);
+    }
 }
 
 /// Present any rendering that was done since the previous call.
 inline void Present(void)
 {
-    SDL_RenderPresent(renderer);
+    ZONE("Present");
+    FlushBatch();
+
+    if ( software_backend ) {
+        PresentFramebuffer();
+    } else {
+        SDL_RenderPresent(renderer);
+    }
 }
 
 /// Draw a rectangle outline with the current draw color.
 inline void DrawRect(SDL_Rect rect)
 {
-    SDL_RenderDrawRect(renderer, &rect);
+    if ( batch_mode || software_backend ) {
+        BatchRect(rect, false);
+    } else {
+        SDL_RenderDrawRect(renderer, &rect);
+    }
 }
 
 /// Draw a filled rectangle with the current draw color.
 inline void FillRect(SDL_Rect rect)
 {
-    SDL_RenderFillRect(renderer, &rect);
+    if ( batch_mode || software_backend ) {
+        BatchRect(rect, true);
+    } else {
+        SDL_RenderFillRect(renderer, &rect);
+    }
 }
 
 /// Draw a point at pixel coordinates x, y.
 inline void DrawPoint(int x, int y)
 {
-    SDL_RenderDrawPoint(renderer, x, y);
+    if ( batch_mode || software_backend ) {
+        BatchPoints(&(SDL_Point){ x, y }, 1);
+    } else {
+        SDL_RenderDrawPoint(renderer, x, y);
+    }
 }
 
 /// Set the draw color.
@@ -107,9 +178,64 @@ inline void SetGray(u8 gray)
 ///   to draw to entire target.
 inline void DrawTexture(SDL_Texture * texture, SDL_Rect * src, SDL_Rect * dst)
 {
-    SDL_RenderCopy(renderer, texture, src, dst);
+    FlushBatch();
+    texture_draws++;
+
+    if ( software_backend ) {
+        DrawTextureSoftware(texture, src, dst);
+    } else {
+        SDL_RenderCopy(renderer, texture, src, dst);
+    }
 }
 
+/// Get an RGBA8888 render target texture from the texture pool.
 SDL_Texture * CreateTexture(int w, int h);
 
+#define DEFAULT_TEXTURE_POOL_BUDGET (64 * 1024 * 1024) // bytes
+
+typedef struct {
+    int hits;
+    int misses;
+    int in_use;     // acquired and not yet released
+    int idle;       // released textures waiting to be reused
+    size_t bytes;   // approximate size of idle textures
+    size_t in_use_bytes; // approximate size of acquired textures
+    size_t budget;
+} texture_pool_stats_t;
+
+/// Get a texture from the pool, or create one if there's no idle texture
+/// with this exact format, access, and size. Its contents are undefined.
+/// Release it with `ReleaseTexture()` instead of destroying it.
+SDL_Texture * AcquireTexture(u32 format, int access, int w, int h);
+
+/// Return a texture to the pool for reuse. If that puts the pool over
+/// budget, the least recently released textures are destroyed. Does
+/// nothing if `texture` is `NULL`.
+void ReleaseTexture(SDL_Texture * texture);
+
+/// Set the maximum number of bytes of idle textures the pool may keep.
+void SetTexturePoolBudget(size_t bytes);
+
+/// Destroy all idle textures.
+void ClearTexturePool(void);
+
+texture_pool_stats_t TexturePoolStats(void);
+
+/// Expand 8-bit palette indices to 32-bit colors. Indices `0...15` are
+/// looked up in `palette`, and `16...127` by their low four bits. Indices
+/// with the high bit set (128...255) become 0, i.e. transparent. Uses SSSE3
+/// or NEON table lookups where available, with the same results.
+void ExpandPalette(const u8 * indices, u32 * colors, int count, const u32 palette[16]);
+
+/// Write 8-bit palette indices to a streaming texture, expanding them with
+/// `ExpandPalette()` directly into the texture's memory.
+/// - Parameter rect: The area to update, or `NULL` for the whole texture.
+/// - Parameter pitch: Bytes between rows of `indices`.
+void UpdateTextureIndexed
+(   SDL_Texture * texture,
+    const SDL_Rect * rect,
+    const u8 * indices,
+    int pitch,
+    const u32 palette[16] );
+
 #endif /* __VIDEO_H__ */
@@ -0,0 +1,185 @@
+#include "snapshot.h"
+#include "mylib/mathlib.h"
+
+// Epochs: `global_epoch` goes up each time a snapshot is retired, and a
+// reader announces the epoch it saw while it's between loading `current`
+// and counting its reference (0 when it isn't). A snapshot retired at
+// epoch e could only have been loaded by a reader that announced e or
+// earlier, so once none has, nothing can reach it.
+
+static world_snapshot_t * current;
+static u64 global_epoch = 1;
+
+static struct {
+    u64 epoch;
+} __attribute__((aligned(64))) readers[MAX_SNAPSHOT_READERS];
+
+static SDL_atomic_t num_readers;
+static _Thread_local int reader_index = -1;
+
+static world_snapshot_t * retired; // refs reached zero, pushed by any thread
+static world_snapshot_t * limbo; // main thread only: waiting on readers
+static SDL_atomic_t alive;
+
+static int ReaderIndex(void)
+{
+    if ( reader_index == -1 ) {
+        reader_index = SDL_AtomicAdd(&num_readers, 1);
+        if ( reader_index >= MAX_SNAPSHOT_READERS ) {
+            Error("too many snapshot reader threads");
+        }
+    }
+
+    return reader_index;
+}
+
+static void Retire(world_snapshot_t * snapshot)
+{
+    snapshot->retired_epoch = __atomic_fetch_add(&global_epoch, 1, __ATOMIC_SEQ_CST);
+
+    world_snapshot_t * head = __atomic_load_n(&retired, __ATOMIC_RELAXED);
+    do {
+        snapshot->next_retired = head;
+    } while ( !__atomic_compare_exchange_n(&retired,
+                                           &head,
+                                           snapshot,
+                                           true,
+                                           __ATOMIC_RELEASE,
+                                           __ATOMIC_RELAXED) );
+}
+
+// Whether a reader might still have loaded a snapshot retired at `epoch`.
+static bool MaybeInUse(u64 epoch)
+{
+    int count = MIN(SDL_AtomicGet(&num_readers), MAX_SNAPSHOT_READERS);
+
+    for ( int i = 0; i < count; i++ ) {
+        u64 reader_epoch = __atomic_load_n(&readers[i].epoch, __ATOMIC_SEQ_CST);
+        if ( reader_epoch != 0 && reader_epoch <= epoch ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void FreeSnapshot(world_snapshot_t * snapshot)
+{
+    MemFree((float *)snapshot->field);
+    MemFree((u8 *)snapshot->classes);
+    MemFree(snapshot);
+    SDL_AtomicAdd(&alive, -1);
+}
+
+#pragma mark - PUBLIC FUNCTIONS
+
+world_snapshot_t * NewSnapshot
+(   u64 key,
+    u64 field_key,
+    int width,
+    int height,
+    float * field,
+    u8 * classes,
+    const float * parameters,
+    int num_parameters )
+{
+    size_t parameters_size = num_parameters * sizeof(*parameters);
+    world_snapshot_t * snapshot = MemAlloc(MEM_GENERATION,
+                                           sizeof(*snapshot) + parameters_size);
+    if ( snapshot == NULL ) {
+        Error("out of memory");
+    }
+
+    // the parameters go right after it
+    float * copy = (float *)(snapshot + 1);
+    memcpy(copy, parameters, parameters_size);
+
+    *snapshot = (world_snapshot_t){
+        .key = key,
+        .field_key = field_key,
+        .width = width,
+        .height = height,
+        .field = field,
+        .classes = classes,
+        .parameters = copy,
+        .num_parameters = num_parameters,
+    };
+
+    SDL_AtomicSet(&snapshot->refs, 1);
+    SDL_AtomicAdd(&alive, 1);
+
+    return snapshot;
+}
+
+void PublishSnapshot(world_snapshot_t * snapshot)
+{
+    world_snapshot_t * old = __atomic_exchange_n(&current, snapshot, __ATOMIC_SEQ_CST);
+
+    if ( old ) {
+        ReleaseSnapshot(old);
+    }
+
+    ReclaimSnapshots();
+}
+
+world_snapshot_t * AcquireSnapshot(void)
+{
+    int index = ReaderIndex();
+    u64 epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&readers[index].epoch, epoch, __ATOMIC_SEQ_CST);
+
+    world_snapshot_t * snapshot;
+    while (( snapshot = __atomic_load_n(&current, __ATOMIC_SEQ_CST) )) {
+        // A count of zero means it was replaced after we loaded it, but
+        // it's still there to look at, thanks to the epoch. Try again.
+        int refs = SDL_AtomicGet(&snapshot->refs);
+        if ( refs > 0 && SDL_AtomicCAS(&snapshot->refs, refs, refs + 1) ) {
+            break;
+        }
+    }
+
+    __atomic_store_n(&readers[index].epoch, 0, __ATOMIC_RELEASE);
+
+    return snapshot;
+}
+
+void ReleaseSnapshot(world_snapshot_t * snapshot)
+{
+    if ( SDL_AtomicDecRef(&snapshot->refs) ) {
+        Retire(snapshot);
+    }
+}
+
+void ReclaimSnapshots(void)
+{
+    world_snapshot_t * list = __atomic_exchange_n(&retired, NULL, __ATOMIC_ACQUIRE);
+
+    while ( list ) {
+        world_snapshot_t * next = list->next_retired;
+        list->next_retired = limbo;
+        limbo = list;
+        list = next;
+    }
+
+    world_snapshot_t ** link = &limbo;
+    while ( *link ) {
+        world_snapshot_t * snapshot = *link;
+
+        if ( MaybeInUse(snapshot->retired_epoch) ) {
+            link = &snapshot->next_retired;
+        } else {
+            *link = snapshot->next_retired;
+            FreeSnapshot(snapshot);
+        }
+    }
+}
+
+void ShutdownSnapshots(void)
+{
+    PublishSnapshot(NULL);
+}
+
+int SnapshotsAlive(void)
+{
+    return SDL_AtomicGet(&alive);
+}
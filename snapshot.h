@@ -0,0 +1,83 @@
+// -----------------------------------------------------------------------------
+//  World Snapshots
+//
+//  The most recently finished world, published for readers on any thread:
+//  its parameters, noise field, and class map, none of which change once
+//  published. The main thread publishes a new snapshot by swapping a
+//  pointer, while readers can carry on with the one they have.
+//
+//  Snapshots are reference counted. The current snapshot holds a reference
+//  of its own, dropped when it's replaced. A reader takes a reference with
+//  `AcquireSnapshot()` and drops it with `ReleaseSnapshot()`:
+//
+//      world_snapshot_t * world = AcquireSnapshot();
+//      if ( world ) {
+//          ... read world->classes ...
+//          ReleaseSnapshot(world);
+//      }
+//
+//  Between loading the pointer and counting its reference, a reader is in
+//  an epoch, so that a snapshot whose count drops to zero in the meantime
+//  isn't freed under it. Unreferenced snapshots are freed by
+//  `ReclaimSnapshots()` once every reader that might have seen them has
+//  left its epoch.
+// -----------------------------------------------------------------------------
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "mylib/genlib.h"
+
+#define MAX_SNAPSHOT_READERS 128 // threads that ever call AcquireSnapshot()
+
+typedef struct world_snapshot {
+    u64 key;            // hash of the parameters
+    u64 field_key;      // 0 if `field` is left over from another world
+    int width;
+    int height;
+    const float * field;        // width * height, masked noise values
+    const u8 * classes;         // width * height, layer index per pixel
+    const float * parameters;   // property values the world was made with
+    int num_parameters;
+
+    SDL_atomic_t refs;
+    u64 retired_epoch;
+    struct world_snapshot * next_retired;
+} world_snapshot_t;
+
+/// Make a snapshot to publish, holding the reference `PublishSnapshot()`
+/// takes over.
+/// - Parameter field: A `MemAlloc()`ed buffer, which now belongs to the
+///   snapshot, as does `classes`.
+/// - Parameter parameters: Copied.
+world_snapshot_t * NewSnapshot
+(   u64 key,
+    u64 field_key,
+    int width,
+    int height,
+    float * field,
+    u8 * classes,
+    const float * parameters,
+    int num_parameters );
+
+/// Make `snapshot` the current one, giving up the previous one's
+/// reference. Main thread only.
+void PublishSnapshot(world_snapshot_t * snapshot);
+
+/// Get a reference to the current snapshot, from any thread.
+/// - Returns: `NULL` if nothing has been published.
+world_snapshot_t * AcquireSnapshot(void);
+
+/// Drop a reference from `AcquireSnapshot()`, from any thread.
+void ReleaseSnapshot(world_snapshot_t * snapshot);
+
+/// Free the snapshots no reader can reach anymore. Main thread only.
+void ReclaimSnapshots(void);
+
+/// Unpublish the current snapshot and free everything left. Other threads
+/// must be done with their snapshots.
+void ShutdownSnapshots(void);
+
+/// The number of snapshots not yet freed, including the current one.
+int SnapshotsAlive(void);
+
+#endif /* __SNAPSHOT_H__ */
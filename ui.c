@@ -0,0 +1,230 @@
+#include "ui.h"
+#include "mylib/text.h"
+#include "mylib/video.h"
+
+typedef struct label {
+    u64 key;
+    SDL_Texture * texture;
+    int width;
+    int height;
+    struct label * prev; // more recently drawn
+    struct label * next; // less recently drawn
+} label_t;
+
+static label_t * head; // most recently drawn
+static label_t * tail; // least recently drawn
+static hashmap_t labels; // label_t by key
+static ui_stats_t stats;
+
+static u64 LabelKey(const char * text, SDL_Color color)
+{
+    font_t font = GetFont();
+    float scale[2];
+    GetTextScale(&scale[0], &scale[1]);
+
+    u64 key = HashBytes(text, strlen(text), FNV_OFFSET);
+    key = HashBytes(&font, sizeof(font), key);
+    key = HashBytes(scale, sizeof(scale), key);
+    key = HashBytes(&color, sizeof(color), key);
+
+    return key;
+}
+
+static void Unlink(label_t * label)
+{
+    if ( label->prev ) {
+        label->prev->next = label->next;
+    } else {
+        head = label->next;
+    }
+
+    if ( label->next ) {
+        label->next->prev = label->prev;
+    } else {
+        tail = label->prev;
+    }
+
+    label->prev = label->next = NULL;
+}
+
+static void PushFront(label_t * label)
+{
+    label->next = head;
+    label->prev = NULL;
+
+    if ( head ) {
+        head->prev = label;
+    } else {
+        tail = label;
+    }
+
+    head = label;
+}
+
+static void Remove(label_t * label)
+{
+    Unlink(label);
+    MapRemove(&labels, label->key);
+    ReleaseTexture(label->texture);
+    MemFree(label);
+    stats.labels--;
+}
+
+// The text on a dark gray box, which has a black box offset behind it.
+static void DrawBoxedText(int x, int y, SDL_Color color, const char * text)
+{
+    int box_w, box_h;
+    LabelSize(text, &box_w, &box_h);
+
+    SetGray(0);
+    FillRect((SDL_Rect){ x + LABEL_MARGIN, y + LABEL_MARGIN, box_w, box_h });
+    SetGray(32);
+    FillRect((SDL_Rect){ x, y, box_w, box_h });
+
+    SetColor(color);
+    Print(x + LABEL_MARGIN, y + LABEL_MARGIN, "%s", text);
+}
+
+// Render a new label texture.
+static label_t * RenderLabel(u64 key, SDL_Color color, const char * text)
+{
+    label_t * label = MemCalloc(MEM_CACHE, 1, sizeof(*label));
+    if ( label == NULL ) {
+        Error("out of memory");
+    }
+
+    int box_w, box_h;
+    LabelSize(text, &box_w, &box_h);
+
+    label->key = key;
+    label->width = box_w + LABEL_MARGIN;
+    label->height = box_h + LABEL_MARGIN;
+    label->texture = AcquireTexture
+    (   SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_TARGET,
+        label->width,
+        label->height );
+
+    FlushBatch(); // anything pending belongs to the old target
+    SDL_Texture * target = SDL_GetRenderTarget(renderer);
+    SDL_SetRenderTarget(renderer, label->texture);
+    SetRGBA(0, 0, 0, 0);
+    Clear();
+    DrawBoxedText(0, 0, color, text);
+
+    SDL_SetRenderTarget(renderer, target);
+    SDL_SetTextureBlendMode(label->texture, SDL_BLENDMODE_BLEND);
+
+    stats.labels++;
+    return label;
+}
+
+void LabelSize(const char * text, int * w, int * h)
+{
+    *w = CharWidth() * strlen(text) + LABEL_MARGIN * 2;
+    *h = CharHeight() + LABEL_MARGIN * 2;
+}
+
+void DrawLabel(int x, int y, SDL_Color color, const char * text)
+{
+    u64 key = LabelKey(text, color);
+    label_t * label = MapGet(&labels, key);
+
+    if ( label ) {
+        Unlink(label);
+        stats.hits++;
+    } else {
+        label = RenderLabel(key, color, text);
+        MapPut(&labels, key, label);
+        stats.misses++;
+    }
+
+    PushFront(label);
+
+    while ( stats.labels > MAX_LABELS ) {
+        Remove(tail);
+    }
+
+    SDL_Rect dst = {
+        x - LABEL_MARGIN,
+        y - LABEL_MARGIN,
+        label->width,
+        label->height
+    };
+    DrawTexture(label->texture, NULL, &dst);
+}
+
+void DrawDynamicLabel(int x, int y, SDL_Color color, const char * text)
+{
+    DrawBoxedText(x - LABEL_MARGIN, y - LABEL_MARGIN, color, text);
+}
+
+bool BeginPanel(ui_panel_t * panel, u64 key, int w, int h)
+{
+    if ( panel->texture && panel->key == key
+        && panel->width == w && panel->height == h )
+    {
+        return false;
+    }
+
+    if ( panel->texture && (panel->width != w || panel->height != h) ) {
+        ReleaseTexture(panel->texture);
+        panel->texture = NULL;
+    }
+
+    if ( panel->texture == NULL ) {
+        panel->texture = AcquireTexture
+        (   SDL_PIXELFORMAT_RGBA8888,
+            SDL_TEXTUREACCESS_TARGET,
+            w,
+            h );
+        SDL_SetTextureBlendMode(panel->texture, SDL_BLENDMODE_BLEND);
+    }
+
+    panel->key = key;
+    panel->width = w;
+    panel->height = h;
+
+    FlushBatch();
+    SDL_SetRenderTarget(renderer, panel->texture);
+    SetRGBA(0, 0, 0, 0);
+    Clear();
+    stats.panel_redraws++;
+
+    return true;
+}
+
+void EndPanel(ui_panel_t * panel)
+{
+    (void)panel;
+    FlushBatch();
+    SDL_SetRenderTarget(renderer, NULL);
+}
+
+void DrawPanel(const ui_panel_t * panel, int x, int y)
+{
+    if ( panel->texture ) {
+        SDL_Rect dst = { x, y, panel->width, panel->height };
+        DrawTexture(panel->texture, NULL, &dst);
+    }
+}
+
+void FreePanel(ui_panel_t * panel)
+{
+    ReleaseTexture(panel->texture);
+    *panel = (ui_panel_t){ 0 };
+}
+
+void ClearUICache(void)
+{
+    while ( head ) {
+        Remove(head);
+    }
+
+    FreeHashMap(&labels);
+}
+
+ui_stats_t UIStats(void)
+{
+    return stats;
+}
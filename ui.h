@@ -0,0 +1,65 @@
+// -----------------------------------------------------------------------------
+//  UI Cache
+//
+//  Retained rendering for text that rarely changes. Labels are rendered
+//  once into textures keyed by their text, font, text scale, and color, so
+//  drawing one again is a single texture copy. Panels go a step further
+//  and composite a group of labels into one texture that is only redrawn
+//  when the caller's key for its contents changes.
+// -----------------------------------------------------------------------------
+#ifndef __UI_H__
+#define __UI_H__
+
+#include "mylib/genlib.h"
+
+#define LABEL_MARGIN 6 // pixels around the text of a label
+#define MAX_LABELS 64 // least recently drawn labels are freed past this
+
+typedef struct {
+    SDL_Texture * texture; // NULL until first drawn
+    u64 key;
+    int width;
+    int height;
+} ui_panel_t;
+
+typedef struct {
+    int hits;           // labels drawn from cache
+    int misses;         // labels that had to be rendered
+    int labels;         // number of labels currently cached
+    int panel_redraws;
+} ui_stats_t;
+
+/// Draw `text` in `color` on a box at x, y, using the current font and
+/// text scale.
+void DrawLabel(int x, int y, SDL_Color color, const char * text);
+
+/// Draw a label like `DrawLabel()`, but straight to the screen instead of
+/// through the cache. For text that changes every frame, such as counters,
+/// which would otherwise render and evict a cached label each time.
+void DrawDynamicLabel(int x, int y, SDL_Color color, const char * text);
+
+/// Size of the label `DrawLabel()` would draw for `text`.
+void LabelSize(const char * text, int * w, int * h);
+
+/// Start drawing into a panel, if its contents are out of date.
+/// - Parameter key: A hash of everything the caller draws into the panel.
+/// - Returns: `true` if the panel needs to be redrawn. In that case, draw
+///   its contents (in panel coordinates) and then call `EndPanel()`.
+bool BeginPanel(ui_panel_t * panel, u64 key, int w, int h);
+
+/// Finish drawing a panel and go back to drawing to the window.
+void EndPanel(ui_panel_t * panel);
+
+/// Copy a panel to the screen with its top left corner at x, y.
+void DrawPanel(const ui_panel_t * panel, int x, int y);
+
+/// Free a panel's texture.
+void FreePanel(ui_panel_t * panel);
+
+/// Free all cached labels, e.g. when render target contents were lost.
+/// Panels should also be invalidated by setting their keys to 0.
+void ClearUICache(void);
+
+ui_stats_t UIStats(void);
+
+#endif /* __UI_H__ */